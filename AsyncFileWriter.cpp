@@ -0,0 +1,346 @@
+// Copyright (C) 2011 Paul Ilardi (http://github.com/CodePi)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, unconditionally.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#include "AsyncFileWriter.h"
+#include <cerrno>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#include <share.h>
+#include <malloc.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace codepi{
+
+using namespace std;
+
+static const size_t DIRECT_ALIGN = 4096;  // O_DIRECT buffer, length and offset alignment
+
+struct AsyncFileWriter::File{
+  string name;
+  string tmpName;                         // written here, renamed to name when complete
+  int fd;
+  bool direct;                            // opened with O_DIRECT
+  bool abandoned;                         // encoding failed, discard the file
+  uint64_t size;                          // bytes queued so far
+  exception_ptr error;                    // first write error
+  promise<void> done;
+};
+
+////////////////////////////////////////////////////////
+// Helpers
+
+static char* alignedAlloc(size_t n){
+#ifdef _WIN32
+  void* p = _aligned_malloc(n, DIRECT_ALIGN);
+  if(!p) throw bad_alloc();
+#else
+  void* p;
+  if(posix_memalign(&p, DIRECT_ALIGN, n)!=0) throw bad_alloc();
+#endif
+  return (char*)p;
+}
+
+static void alignedFree(char* p){
+#ifdef _WIN32
+  _aligned_free(p);
+#else
+  free(p);
+#endif
+}
+
+// Create name for writing, with O_DIRECT if direct is set and the file system takes it
+// (direct is cleared otherwise).  Returns -1 on failure.
+static int openOutput(const string& name, bool& direct){
+#ifdef _WIN32
+  direct = false;
+  int fd;
+  if(_sopen_s(&fd, name.c_str(), _O_WRONLY|_O_CREAT|_O_TRUNC|_O_BINARY, _SH_DENYNO,
+              _S_IREAD|_S_IWRITE)!=0) return -1;
+  return fd;
+#else
+  int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+  if(direct){
+    int fd = open(name.c_str(), flags | O_DIRECT, 0666);
+    if(fd>=0) return fd;                  // e.g. tmpfs refuses O_DIRECT, use the cache
+  }
+#endif
+  direct = false;
+  return open(name.c_str(), flags, 0666);
+#endif
+}
+
+static bool writeAll(int fd, const char* p, size_t n){
+  while(n>0){
+#ifdef _WIN32
+    int w = _write(fd, p, unsigned(min(n, size_t(1)<<30)));
+#else
+    ssize_t w = write(fd, p, n);
+    if(w<0 && errno==EINTR) continue;
+#endif
+    if(w<=0) return false;
+    p += w;
+    n -= size_t(w);
+  }
+  return true;
+}
+
+static bool truncateFd(int fd, uint64_t size){
+#ifdef _WIN32
+  return _chsize_s(fd, size)==0;
+#else
+  return ftruncate(fd, off_t(size))==0;
+#endif
+}
+
+static bool syncFd(int fd){
+#ifdef _WIN32
+  return _commit(fd)==0;
+#elif defined(__APPLE__)
+  return fsync(fd)==0;
+#else
+  return fdatasync(fd)==0;
+#endif
+}
+
+static bool closeFd(int fd){
+#ifdef _WIN32
+  return _close(fd)==0;
+#else
+  return close(fd)==0;
+#endif
+}
+
+// atomically replace name with tmpName
+static bool replaceFile(const string& tmpName, const string& name){
+#ifdef _WIN32
+  return MoveFileExA(tmpName.c_str(), name.c_str(), MOVEFILE_REPLACE_EXISTING)!=0;
+#else
+  return rename(tmpName.c_str(), name.c_str())==0;
+#endif
+}
+
+// sync the directory holding name, so a rename into it survives a crash (best effort)
+static void syncDirectory(const string& name){
+#ifndef _WIN32
+  size_t slash = name.rfind('/');
+  string dir = slash==string::npos ? "." : slash==0 ? "/" : name.substr(0, slash);
+  int fd = open(dir.c_str(), O_RDONLY);
+  if(fd<0) return;
+  fsync(fd);
+  close(fd);
+#endif
+}
+
+static exception_ptr writeError(const char* msg){
+  return make_exception_ptr(runtime_error(msg));
+}
+
+////////////////////////////////////////////////////////
+// Sink queuing each full block and continuing in a free one
+
+class AsyncFileWriter::Sink : public BufferSink{
+public:
+  Sink(AsyncFileWriter& writer, File* file, char* block)
+    : mWriter(writer), mpFile(file), mpBlock(block) {}
+
+  void drain(const char* data, size_t n){
+    mWriter.push((char*)data, n, mpFile);
+    mpBlock = NULL;
+  }
+
+  char* nextBlock(char*){
+    mpBlock = mWriter.takeBlock();
+    return mpBlock;
+  }
+
+  char* block() const { return mpBlock; }   // block being filled (NULL once drained)
+
+private:
+  AsyncFileWriter& mWriter;
+  File* mpFile;
+  char* mpBlock;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// AsyncFileWriter method implementations
+
+AsyncFileWriter::AsyncFileWriter(int options, size_t blockSize, unsigned blocks)
+  : mOptions(options), mOpenFiles(0), mStop(false){
+  mBlockSize = (max(blockSize, size_t(1)) + DIRECT_ALIGN-1) / DIRECT_ALIGN * DIRECT_ALIGN;
+  try{
+    for(unsigned i=0; i<max(blocks, 1u); i++){
+      mPool.push_back(alignedAlloc(mBlockSize));
+      memset(mPool.back(), 0, mBlockSize);  // fault pages in now, not during a write
+    }
+  }catch(...){
+    for(size_t i=0; i<mPool.size(); i++) alignedFree(mPool[i]);
+    throw;
+  }
+  mFree = mPool;
+  mThread = thread(&AsyncFileWriter::run, this);
+}
+
+AsyncFileWriter::~AsyncFileWriter(){
+  {
+    lock_guard<mutex> lock(mMutex);
+    mStop = true;
+  }
+  mQueued.notify_one();
+  mThread.join();                         // returns once the queue is empty
+  for(size_t i=0; i<mPool.size(); i++) alignedFree(mPool[i]);
+}
+
+future<void> AsyncFileWriter::binSerializeFile(Serialator& obj, const string& filename){
+  File* file = openFile(filename);
+  future<void> done = file->done.get_future();
+  char* block = takeBlock();
+  Sink sink(*this, file, block);
+  try{
+    BufferWriter bw(block, block+mBlockSize, sink);
+    BinWriteArchive ar(bw);
+    ar & obj;
+    bw.finish();                          // queues the last block
+  }catch(...){
+    char* current = sink.block();
+    lock_guard<mutex> lock(mMutex);
+    if(current) mFree.push_back(current);
+    mFreed.notify_all();
+    file->abandoned = true;
+    Block end = { NULL, 0, file };
+    mQueue.push_back(end);
+    mQueued.notify_one();
+    throw;
+  }
+  push(NULL, 0, file);
+  return done;
+}
+
+future<void> AsyncFileWriter::binSerializeFile(Serialator& obj, const string& filename,
+                                               Archive::BinFormat format){
+  if(format==Archive::BIN_DEFAULT) return binSerializeFile(obj, filename);
+  vector<char> blob;
+  obj.binSerialize(blob, format);
+  File* file = openFile(filename);
+  future<void> done = file->done.get_future();
+  for(size_t at=0; at<blob.size(); at+=mBlockSize){
+    size_t n = min(mBlockSize, blob.size()-at);
+    char* block = takeBlock();
+    memcpy(block, &blob[at], n);
+    push(block, n, file);
+  }
+  push(NULL, 0, file);
+  return done;
+}
+
+void AsyncFileWriter::wait(){
+  unique_lock<mutex> lock(mMutex);
+  mFreed.wait(lock, [this]{ return mOpenFiles==0; });
+}
+
+AsyncFileWriter::File* AsyncFileWriter::openFile(const string& filename){
+  File* file = new File;
+  file->name = filename;
+  file->tmpName = filename + ".tmp";
+  file->direct = (mOptions & ASYNC_DIRECT)!=0;
+  file->abandoned = false;
+  file->size = 0;
+  file->fd = openOutput(file->tmpName, file->direct);
+  if(file->fd<0){
+    delete file;
+    throw runtime_error("AsyncFileWriter: cannot open file");
+  }
+  lock_guard<mutex> lock(mMutex);
+  mOpenFiles++;
+  return file;
+}
+
+void AsyncFileWriter::push(char* data, size_t size, File* file){
+  Block block = { data, size, file };
+  lock_guard<mutex> lock(mMutex);
+  mQueue.push_back(block);
+  mQueued.notify_one();
+}
+
+char* AsyncFileWriter::takeBlock(){
+  unique_lock<mutex> lock(mMutex);
+  mFreed.wait(lock, [this]{ return !mFree.empty(); });
+  char* block = mFree.back();
+  mFree.pop_back();
+  return block;
+}
+
+void AsyncFileWriter::run(){
+  unique_lock<mutex> lock(mMutex);
+  for(;;){
+    mQueued.wait(lock, [this]{ return !mQueue.empty() || mStop; });
+    if(mQueue.empty()) return;            // stopping and nothing left to write
+    Block block = mQueue.front();
+    mQueue.pop_front();
+    lock.unlock();
+    if(block.data) writeBlock(block);
+    else closeFile(block.file);
+    lock.lock();
+    if(block.data) mFree.push_back(block.data);
+    else mOpenFiles--;
+    mFreed.notify_all();
+  }
+}
+
+// Blocks are full pool blocks, so O_DIRECT offsets stay aligned.  A short last block is
+// padded to the alignment and the file trimmed back when it is closed.
+void AsyncFileWriter::writeBlock(const Block& block){
+  File* file = block.file;
+  file->size += block.size;
+  if(file->error) return;
+  size_t n = block.size;
+  if(file->direct && n % DIRECT_ALIGN){
+    size_t padded = (n + DIRECT_ALIGN-1) / DIRECT_ALIGN * DIRECT_ALIGN;
+    memset(block.data + n, 0, padded - n);
+    n = padded;
+  }
+  if(!writeAll(file->fd, block.data, n)) file->error = writeError("AsyncFileWriter: write error");
+}
+
+void AsyncFileWriter::closeFile(File* file){
+  if(!file->error && !file->abandoned){
+    if(file->direct && !truncateFd(file->fd, file->size))
+      file->error = writeError("AsyncFileWriter: cannot truncate file");
+    else if((mOptions & ASYNC_SYNC) && !syncFd(file->fd))
+      file->error = writeError("AsyncFileWriter: sync error");
+  }
+  if(!closeFd(file->fd) && !file->error) file->error = writeError("AsyncFileWriter: write error");
+  if(!file->error && !file->abandoned){
+    if(!replaceFile(file->tmpName, file->name))
+      file->error = writeError("AsyncFileWriter: cannot rename file");
+    else if(mOptions & ASYNC_SYNC) syncDirectory(file->name);
+  }
+  if(file->error || file->abandoned) remove(file->tmpName.c_str());
+  if(file->error) file->done.set_exception(file->error);
+  else if(!file->abandoned) file->done.set_value();
+  delete file;
+}
+
+}; //end namespace codepi
@@ -0,0 +1,106 @@
+// Copyright (C) 2011 Paul Ilardi (http://github.com/CodePi)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, unconditionally.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+// Background file writer for checkpointing Serialator objects.  Requires linking
+// with the platform thread library.
+//
+//   AsyncFileWriter writer;
+//   std::future<void> done = writer.binSerializeFile(state, "state.bin");
+//   ...                        // state may change again as soon as the call returns
+//   done.get();                // file written and synced, or rethrows the write error
+//
+// The calling thread only encodes.  Output is cut into fixed size blocks from a small
+// pool, and a background thread writes each full block while the next one is filled.
+// The caller waits only when every block is still queued for the disk, so with a pool
+// at least as large as the object a call costs just the in-memory encode.
+//
+// Files are written under a temporary name (filename + ".tmp") and renamed over
+// filename once complete, so a crash mid-write leaves the previous file intact.
+
+#pragma once
+
+#include "Serialator.h"
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace codepi{
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// AsyncFileWriter class
+//   Serializes objects on the calling thread and writes them to files on a background
+//   thread, one file after another in call order.
+class AsyncFileWriter{
+public:
+  // Options, combined with |
+  enum Options{
+    ASYNC_DEFAULT = 0,
+    ASYNC_DIRECT  = 1,  // O_DIRECT writes that bypass the page cache, where the OS and
+                        //   file system support it (silently buffered otherwise)
+    ASYNC_SYNC    = 2   // fdatasync each file once, before renaming it and completing
+                        //   its future, so a ready future means the data is durable
+  };
+
+  // blockSize is rounded up to a multiple of 4KB.  The pool holds blocks buffers.
+  explicit AsyncFileWriter(int options=ASYNC_SYNC, size_t blockSize=size_t(8)<<20,
+                           unsigned blocks=4);
+  ~AsyncFileWriter();                       // finishes queued files
+
+  // Serialize obj and queue it for writing to filename.  Returns once obj is encoded.
+  // The future becomes ready when the file is in place, or holds the write error.
+  // Encoding errors throw here.  Formats other than BIN_DEFAULT are encoded into memory
+  // first, since BIN_CHECKED and BIN_FRAMED headers are filled in after the fact.
+  std::future<void> binSerializeFile(Serialator& obj, const std::string& filename);
+  std::future<void> binSerializeFile(Serialator& obj, const std::string& filename,
+                                     Archive::BinFormat format);
+
+  void wait();                              // until every queued file is complete
+
+private:
+  AsyncFileWriter(const AsyncFileWriter&);            // not copyable
+  AsyncFileWriter& operator=(const AsyncFileWriter&);
+
+  struct File;                              // one file being written
+  struct Block{                             // queued write, NULL data ends the file
+    char* data;
+    size_t size;
+    File* file;
+  };
+  class Sink;
+
+  File* openFile(const std::string& filename);
+  void push(char* data, size_t size, File* file);  // queue a block (or end of file)
+  char* takeBlock();                        // wait for a free pool block
+  void run();                               // background thread
+  void writeBlock(const Block& block);
+  void closeFile(File* file);
+
+  int mOptions;
+  size_t mBlockSize;
+  std::vector<char*> mPool;                 // all blocks, aligned for O_DIRECT
+  std::vector<char*> mFree;                 // blocks not queued or being filled
+  std::deque<Block> mQueue;
+  size_t mOpenFiles;                        // files not yet closed by the thread
+  bool mStop;
+  std::mutex mMutex;
+  std::condition_variable mQueued;          // block queued or stop requested
+  std::condition_variable mFreed;           // block returned to pool or file closed
+  std::thread mThread;
+};
+
+}; //end namespace codepi
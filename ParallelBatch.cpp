@@ -0,0 +1,142 @@
+// Copyright (C) 2011 Paul Ilardi (http://github.com/CodePi)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, unconditionally.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#include "ParallelBatch.h"
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+
+namespace codepi{
+
+using namespace std;
+
+////////////////////////////////////////////////////////
+// Work stealing range scheduler for parallelFor
+//   Each worker owns a [begin,end) range and takes small chunks from its front.
+//   An idle worker steals the back half of the largest remaining range.
+
+namespace{
+
+struct WorkRange{
+  mutex m;
+  size_t begin, end;
+};
+
+class WorkStealer{
+public:
+  WorkStealer(size_t n, unsigned workers, const function<void(size_t,size_t)>& body)
+    : mRanges(workers), mBody(body), mFailed(false){
+      mGrain = max<size_t>(1, n / (workers*64)); // enough chunks to balance load
+      for(unsigned w=0; w<workers; w++){
+        mRanges[w].begin = n * w / workers;
+        mRanges[w].end   = n * (w+1) / workers;
+      }
+  }
+
+  void run(unsigned self){
+    size_t begin, end;
+    while(!mFailed && (takeOwn(self, begin, end) || steal(self, begin, end))){
+      try{ 
+        mBody(begin, end); 
+      }catch(...){
+        lock_guard<mutex> lock(mErrorMutex);
+        if(!mFailed) mError = current_exception();
+        mFailed = true;
+      }
+    }
+  }
+
+  void rethrow(){ if(mError) rethrow_exception(mError); }
+
+private:
+  // take the next chunk from the front of our own range
+  bool takeOwn(unsigned self, size_t& begin, size_t& end){
+    WorkRange& r = mRanges[self];
+    lock_guard<mutex> lock(r.m);
+    if(r.begin>=r.end) return false;
+    begin = r.begin;
+    end = r.begin = min(r.end, r.begin + mGrain);
+    return true;
+  }
+
+  // move the back half of the largest other range into our own, then take from it
+  bool steal(unsigned self, size_t& begin, size_t& end){
+    while(true){
+      unsigned victim = self;
+      size_t most = 0;
+      for(unsigned w=0; w<mRanges.size(); w++){
+        lock_guard<mutex> lock(mRanges[w].m);
+        size_t left = mRanges[w].end - mRanges[w].begin;
+        if(w!=self && left>most){ most = left; victim = w; }
+      }
+      if(victim==self) return false;          // nothing left anywhere
+
+      size_t stolenBegin, stolenEnd;
+      {
+        lock_guard<mutex> lock(mRanges[victim].m);
+        WorkRange& v = mRanges[victim];
+        if(v.begin>=v.end) continue;          // drained meanwhile, look again
+        stolenBegin = v.begin + (v.end - v.begin)/2;
+        stolenEnd = v.end;
+        v.end = stolenBegin;
+      }
+      {
+        lock_guard<mutex> lock(mRanges[self].m);
+        mRanges[self].begin = stolenBegin;
+        mRanges[self].end = stolenEnd;
+      }
+      if(takeOwn(self, begin, end)) return true;
+    }
+  }
+
+  vector<WorkRange> mRanges;
+  const function<void(size_t,size_t)>& mBody;
+  size_t mGrain;
+  atomic<bool> mFailed;
+  mutex mErrorMutex;
+  exception_ptr mError;
+};
+
+} // anonymous namespace
+
+void parallelFor(size_t n, unsigned threads, const function<void(size_t,size_t)>& body){
+  if(threads==0) threads = max(1u, thread::hardware_concurrency());
+  threads = unsigned(min<size_t>(threads, n));
+  if(threads<=1){                             // not worth spawning threads
+    if(n>0) body(0, n);
+    return;
+  }
+
+  WorkStealer stealer(n, threads, body);
+  vector<thread> pool;
+  for(unsigned w=1; w<threads; w++) pool.push_back(thread(&WorkStealer::run, &stealer, w));
+  stealer.run(0);                             // calling thread is worker 0
+  for(size_t i=0; i<pool.size(); i++) pool[i].join();
+  stealer.rethrow();
+}
+
+void decompressParallel(const char* data, size_t size, vector<char>& out, unsigned threads){
+  vector<BlockCodec::Block> blocks;
+  out.resize(BlockCodec::scan(data, size, blocks));
+  parallelFor(blocks.size(), threads, [&](size_t begin, size_t end){
+    for(size_t i=begin; i<end; i++) BlockCodec::decompressBlock(blocks[i], &out[0] + blocks[i].rawOffset);
+  });
+}
+
+}; //end namespace codepi
@@ -0,0 +1,110 @@
+// Copyright (C) 2011 Paul Ilardi (http://github.com/CodePi)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, unconditionally.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+// Parallel batch serialization of many Serialator objects into one contiguous
+// buffer with an offset table.  Requires linking with the platform thread library.
+//
+//   std::vector<Tick> ticks = ...;
+//   std::vector<char> blob;
+//   std::vector<uint64_t> offsets;
+//   binSerializeBatch(ticks.begin(), ticks.end(), blob, offsets);
+//   binDeserializeBatch(blob, offsets, ticks.begin());
+
+#pragma once
+
+#include "Serialator.h"
+#include <functional>
+#include <climits>
+
+namespace codepi{
+
+// Run body(begin,end) over sub-ranges of [0,n) on up to threads threads (0 means
+// hardware concurrency).  Each thread starts with an equal share and steals half of
+// the remaining work of another thread when its own runs out.  The calling thread
+// takes part.  The first exception thrown by body is rethrown after all threads join.
+void parallelFor(size_t n, unsigned threads, const std::function<void(size_t,size_t)>& body);
+
+// Accept ranges of objects or of pointers to objects
+inline Serialator& batchElement(Serialator& obj){ return obj; }
+inline Serialator& batchElement(Serialator* obj){ return *obj; }
+
+// Serialize [first,last) into blob.  offsets gets one entry per object giving its start
+// in blob, plus a final entry equal to blob.size().  Objects are sized in parallel,
+// placed with a prefix sum, then written in parallel straight into blob.
+template <typename Iter>
+void binSerializeBatch(Iter first, Iter last, std::vector<char>& blob, 
+                       std::vector<uint64_t>& offsets, unsigned threads=0){
+  size_t n = last - first;
+  offsets.assign(n+1, 0);
+
+  // per object sizes, stored one slot ahead for the prefix sum
+  parallelFor(n, threads, [&](size_t begin, size_t end){
+    for(size_t i=begin; i<end; i++) offsets[i+1] = batchElement(first[i]).binSerializedSize();
+  });
+  for(size_t i=0; i<n; i++){
+    if(offsets[i+1] > uint64_t(INT_MAX))
+      throw std::runtime_error("binSerializeBatch: object too large");
+    offsets[i+1] += offsets[i];
+  }
+
+  blob.resize(offsets[n]);
+  parallelFor(n, threads, [&](size_t begin, size_t end){
+    for(size_t i=begin; i<end; i++){
+      int size = int(offsets[i+1] - offsets[i]);
+      if(batchElement(first[i]).binSerialize(&blob[0] + offsets[i], size)!=size)
+        throw std::runtime_error("binSerializeBatch: object changed size during serialization");
+    }
+  });
+}
+
+// Throw unless offsets are non-decreasing and each object fits binDeserialize's int size
+inline void checkBatchOffsets(const std::vector<uint64_t>& offsets){
+  for(size_t i=1; i<offsets.size(); i++){
+    if(offsets[i] < offsets[i-1]) 
+      throw std::runtime_error("binDeserializeBatch: offsets out of order");
+    if(offsets[i] - offsets[i-1] > uint64_t(INT_MAX))
+      throw std::runtime_error("binDeserializeBatch: object too large");
+  }
+}
+
+// Deserialize offsets.size()-1 objects from blob into the range starting at first.
+// blob must hold at least offsets.back() bytes.
+template <typename Iter>
+void binDeserializeBatch(const char* blob, const std::vector<uint64_t>& offsets, 
+                         Iter first, unsigned threads=0){
+  checkBatchOffsets(offsets);
+  size_t n = offsets.empty() ? 0 : offsets.size()-1;
+  parallelFor(n, threads, [&](size_t begin, size_t end){
+    for(size_t i=begin; i<end; i++){
+      batchElement(first[i]).binDeserialize(blob + offsets[i], int(offsets[i+1] - offsets[i]));
+    }
+  });
+}
+
+template <typename Iter>
+void binDeserializeBatch(const std::vector<char>& blob, const std::vector<uint64_t>& offsets, 
+                         Iter first, unsigned threads=0){
+  if(!offsets.empty() && offsets.back() > blob.size()) 
+    throw std::runtime_error("binDeserializeBatch: offsets exceed blob size");
+  binDeserializeBatch(blob.empty() ? NULL : &blob[0], offsets, first, threads);
+}
+
+// Decompress a BlockCodec stream (see Compression) into out, blocks spread across threads.
+// The result can then be read with the plain binDeserialize overloads.
+void decompressParallel(const char* data, size_t size, std::vector<char>& out, unsigned threads=0);
+
+}; //end namespace codepi
@@ -0,0 +1,259 @@
+// Copyright (C) 2011 Paul Ilardi (http://github.com/CodePi)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, unconditionally.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#include "RecordLog.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <share.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+#include <climits>
+
+namespace codepi{
+
+using namespace std;
+
+static const uint32_t LOG_MAGIC     = 0x474c5253; // "SRLG"
+static const uint32_t LOG_VERSION   = 1;
+static const uint32_t FOOTER_MAGIC  = 0x464c5253; // "SRLF"
+static const uint32_t INDEX_MARKER  = 0xFFFFFFFF; // reserved record length
+static const size_t   HEADER_SIZE   = 8;
+static const size_t   RECORD_HEADER = 8;
+static const size_t   FOOTER_SIZE   = 12;
+
+////////////////////////////////////////////////////////
+// Helpers
+
+// unaligned loads from the mapped file
+static uint32_t load32(const char* p){ uint32_t v; memcpy(&v, p, 4); return v; }
+static uint64_t load64(const char* p){ uint64_t v; memcpy(&v, p, 8); return v; }
+
+static uint32_t crc32c(const char* data, size_t n){ return Crc32c::compute(data, n); }
+
+// Locate the trailing index.  Returns pointer to the first offset and sets count
+// and indexStart, or returns NULL if the file was not closed cleanly.
+static const char* findIndex(const char* base, size_t size, size_t& count, uint64_t& indexStart){
+  if(size < HEADER_SIZE + 4 + 8 + FOOTER_SIZE) return NULL;
+  const char* footer = base + size - FOOTER_SIZE;
+  if(load32(footer+8)!=FOOTER_MAGIC) return NULL;
+  indexStart = load64(footer);
+  if(indexStart < HEADER_SIZE || indexStart > size - FOOTER_SIZE - 12) return NULL;
+  const char* index = base + indexStart;
+  if(load32(index)!=INDEX_MARKER) return NULL;
+  uint64_t n = load64(index+4);
+  uint64_t indexBytes = size - FOOTER_SIZE - indexStart - 12;
+  if(indexBytes % 8 || n != indexBytes / 8) return NULL;
+  count = size_t(n);
+  return index + 12;
+}
+
+// Walk records from the header, stopping at the index marker or at the first
+// truncated or corrupt record.  Returns the offset just past the last good record.
+static uint64_t scanRecords(const char* base, size_t size, vector<uint64_t>& offsets){
+  offsets.clear();
+  uint64_t pos = HEADER_SIZE;
+  while(pos + RECORD_HEADER <= size){
+    uint32_t len = load32(base+pos);
+    if(len==INDEX_MARKER) break;                              // clean index block
+    if(len > size - pos - RECORD_HEADER) break;               // truncated tail
+    if(crc32c(base+pos+RECORD_HEADER, len)!=load32(base+pos+4)) break; // torn write
+    offsets.push_back(pos);
+    pos += RECORD_HEADER + len;
+  }
+  return pos;
+}
+
+static bool checkHeader(const char* base, size_t size){
+  return size >= HEADER_SIZE && load32(base)==LOG_MAGIC && load32(base+4)==LOG_VERSION;
+}
+
+// Contents of filename: the mapping if there is one, else the file read into fallback.
+// Returns false if the file can't be read.
+static bool loadFile(const string& filename, const MappedFile& mapped, vector<char>& fallback,
+                     const char*& base, size_t& size){
+  if(mapped.isMapped()){
+    base = mapped.data();
+    size = mapped.size();
+    return true;
+  }
+  ifstream ifs(filename.c_str(), ios::binary); // no mmap, read whole file
+  if(ifs.fail()) return false;
+  fallback.assign(istreambuf_iterator<char>(ifs), istreambuf_iterator<char>());
+  if(ifs.bad()) return false;
+  base = fallback.empty() ? NULL : &fallback[0];
+  size = fallback.size();
+  return true;
+}
+
+// size of filename in bytes, 0 if it doesn't exist
+static uint64_t fileSize(const string& filename){
+#ifdef _WIN32
+  struct _stat64 st;
+  if(_stat64(filename.c_str(), &st)!=0) return 0;
+#else
+  struct stat st;
+  if(stat(filename.c_str(), &st)!=0) return 0;
+#endif
+  return uint64_t(st.st_size);
+}
+
+static void truncateFile(const string& filename, uint64_t size){
+#ifdef _WIN32
+  int fd;
+  if(_sopen_s(&fd, filename.c_str(), _O_RDWR|_O_BINARY, _SH_DENYNO, _S_IWRITE)!=0
+    || _chsize_s(fd, size)!=0) throw runtime_error("RecordLogWriter: cannot truncate file");
+  _close(fd);
+#else
+  if(truncate(filename.c_str(), off_t(size))!=0)
+    throw runtime_error("RecordLogWriter: cannot truncate file");
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// RecordLogWriter method implementations
+
+RecordLogWriter::RecordLogWriter(const string& filename, bool append)
+  : mFilename(filename), mEnd(HEADER_SIZE){
+  if(append && fileSize(filename)==0) append = false; // missing or empty, start fresh
+  if(append){
+    MappedFile existing(filename);
+    vector<char> fallback;
+    const char* base = NULL;
+    size_t size = 0;
+    if(!loadFile(filename, existing, fallback, base, size))
+      throw runtime_error("RecordLogWriter: cannot read file");
+    if(!checkHeader(base, size))
+      throw runtime_error("RecordLogWriter: not a record log file");
+    size_t count;
+    uint64_t indexStart;
+    const char* index = findIndex(base, size, count, indexStart);
+    if(index){                             // clean file, reuse its index
+      mOffsets.resize(count);
+      for(size_t i=0;i<count;i++) mOffsets[i] = load64(index + 8*i);
+      mEnd = indexStart;
+    }else{                                 // crashed writer, rebuild
+      mEnd = scanRecords(base, size, mOffsets);
+    }
+  }
+
+  if(append){
+    truncateFile(filename, mEnd);          // drop old index and any torn tail
+    mFile.open(filename.c_str(), ios::binary | ios::in | ios::out);
+    if(mFile.fail()) throw runtime_error("RecordLogWriter: cannot open file");
+    mFile.seekp(mEnd);
+  }else{
+    mFile.open(filename.c_str(), ios::binary | ios::out | ios::trunc);
+    if(mFile.fail()) throw runtime_error("RecordLogWriter: cannot open file");
+    uint32_t header[2] = { LOG_MAGIC, LOG_VERSION };
+    mFile.write((const char*)header, sizeof(header));
+  }
+}
+
+RecordLogWriter::~RecordLogWriter(){
+  try{ close(); }catch(...){}
+}
+
+size_t RecordLogWriter::append(Serialator& obj){
+  mScratch.resize(RECORD_HEADER);          // room for length and checksum
+  obj.binSerializeAppend(mScratch);
+  writeRecord();
+  return mOffsets.size()-1;
+}
+
+size_t RecordLogWriter::append(const char* data, size_t size){
+  mScratch.resize(RECORD_HEADER);
+  mScratch.insert(mScratch.end(), data, data+size);
+  writeRecord();
+  return mOffsets.size()-1;
+}
+
+void RecordLogWriter::writeRecord(){
+  if(!mFile.is_open()) throw runtime_error("RecordLogWriter: log is closed");
+  size_t len = mScratch.size() - RECORD_HEADER;
+  if(len >= INDEX_MARKER) throw runtime_error("RecordLogWriter: record too large");
+  uint32_t header[2] = { uint32_t(len), crc32c(&mScratch[RECORD_HEADER], len) };
+  memcpy(&mScratch[0], header, sizeof(header));
+  mFile.write(&mScratch[0], mScratch.size());
+  if(mFile.fail()) throw runtime_error("RecordLogWriter: write error");
+  mOffsets.push_back(mEnd);
+  mEnd += mScratch.size();
+}
+
+void RecordLogWriter::flush(){
+  mFile.flush();
+}
+
+void RecordLogWriter::close(){
+  if(!mFile.is_open()) return;
+  uint64_t count = mOffsets.size();
+  mFile.write((const char*)&INDEX_MARKER, 4);
+  mFile.write((const char*)&count, 8);
+  if(count>0) mFile.write((const char*)&mOffsets[0], 8*count);
+  mFile.write((const char*)&mEnd, 8);      // index starts where records end
+  mFile.write((const char*)&FOOTER_MAGIC, 4);
+  mFile.close();
+  if(mFile.fail()) throw runtime_error("RecordLogWriter: write error");
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// RecordLogReader method implementations
+
+RecordLogReader::RecordLogReader(const string& filename)
+  : mFile(filename), mpBase(NULL), mFileSize(0), mRecordsEnd(0), mpIndex(NULL), mCount(0), 
+    mRecovered(false){
+  if(!loadFile(filename, mFile, mFallback, mpBase, mFileSize))
+    throw runtime_error("RecordLogReader: cannot open file");
+  if(!checkHeader(mpBase, mFileSize)) throw runtime_error("RecordLogReader: not a record log file");
+
+  mpIndex = findIndex(mpBase, mFileSize, mCount, mRecordsEnd);
+  if(!mpIndex){                            // writer didn't close, rebuild index
+    mRecordsEnd = scanRecords(mpBase, mFileSize, mScanned);
+    mCount = mScanned.size();
+    mRecovered = true;
+  }
+}
+
+uint64_t RecordLogReader::offset(size_t n) const{
+  return mpIndex ? load64(mpIndex + 8*n) : mScanned[n];
+}
+
+RecordLogReader::Record RecordLogReader::record(size_t n) const{
+  if(n>=mCount) throw out_of_range("RecordLogReader: record number out of range");
+  uint64_t off = offset(n);
+  if(off < HEADER_SIZE || off > mRecordsEnd || mRecordsEnd - off < RECORD_HEADER)
+    throw runtime_error("RecordLogReader: corrupt record offset");
+  const char* p = mpBase + off;
+  Record rec = { p + RECORD_HEADER, load32(p) };
+  if(rec.size > mRecordsEnd - off - RECORD_HEADER)
+    throw runtime_error("RecordLogReader: corrupt record length");
+  if(mpIndex && crc32c(rec.data, rec.size)!=load32(p+4))   // scanned records were checked
+    throw runtime_error("RecordLogReader: record checksum error");
+  return rec;
+}
+
+void RecordLogReader::read(size_t n, Serialator& obj) const{
+  Record rec = record(n);
+  if(rec.size > uint32_t(INT_MAX)) throw runtime_error("RecordLogReader: record too large to read");
+  obj.binDeserialize(rec.data, int(rec.size));
+}
+
+}; //end namespace codepi
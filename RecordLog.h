@@ -0,0 +1,118 @@
+// Copyright (C) 2011 Paul Ilardi (http://github.com/CodePi)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, unconditionally.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+// Append-only record log built on Serialator.
+//
+// File layout (host byte order, like the Serialator binary format):
+//   header   : uint32 magic "SRLG", uint32 format version
+//   record   : uint32 payload length, uint32 CRC32C of payload, payload
+//   ...
+//   index    : uint32 0xFFFFFFFF marker, uint64 record count, uint64 offset per record
+//   footer   : uint64 offset of index, uint32 magic "SRLF"
+//
+// The index and footer are written by RecordLogWriter::close().  If a writer dies
+// before closing, readers (and writers reopening in append mode) rebuild the index
+// by scanning records, stopping at the first truncated or corrupt one.
+
+#pragma once
+
+#include "Serialator.h"
+#include <fstream>
+
+namespace codepi{
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// RecordLogWriter class
+//   Appends length-prefixed records to a log file.  Records are any Serialator
+//   (binary serialized) or raw byte blobs.
+class RecordLogWriter{
+public:
+  // Create filename, or if append is set reopen it, dropping any torn tail
+  explicit RecordLogWriter(const std::string& filename, bool append=false);
+  ~RecordLogWriter();                       // closes if still open
+
+  size_t append(Serialator& obj);           // returns the record number
+  size_t append(const char* data, size_t size);
+
+  void flush();                             // flush buffered records to the OS
+  void close();                             // write trailing index and close
+
+  size_t size() const { return mOffsets.size(); } // number of records
+
+private:
+  RecordLogWriter(const RecordLogWriter&);            // not copyable
+  RecordLogWriter& operator=(const RecordLogWriter&);
+
+  void writeRecord();                       // write mScratch as the next record
+
+  std::string mFilename;
+  std::fstream mFile;
+  std::vector<uint64_t> mOffsets;           // offset of each record
+  uint64_t mEnd;                            // offset after last record
+  std::vector<char> mScratch;               // reused record buffer
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// RecordLogReader class
+//   Memory maps a log file and gives O(1) access to record n.  Records are handed
+//   back as pointers into the mapping, so deserializing them does not copy the file
+//   and zero-copy views stay valid while the reader is alive.
+class RecordLogReader{
+public:
+  struct Record{
+    const char* data;
+    uint32_t size;
+  };
+
+  explicit RecordLogReader(const std::string& filename);
+
+  size_t size() const { return mCount; }     // number of valid records
+  bool recovered() const { return mRecovered; } // true if index was rebuilt by scanning
+
+  Record record(size_t n) const;             // O(1) lookup of record n, checked against its CRC
+  void read(size_t n, Serialator& obj) const; // binDeserialize record n into obj
+
+  // forward iteration over records
+  class const_iterator{
+  public:
+    const_iterator(const RecordLogReader* log, size_t n) : mpLog(log), mN(n) {}
+    Record operator*() const { return mpLog->record(mN); }
+    const_iterator& operator++(){ mN++; return *this; }
+    bool operator!=(const const_iterator& o) const { return mN!=o.mN; }
+    bool operator==(const const_iterator& o) const { return mN==o.mN; }
+  private:
+    const RecordLogReader* mpLog;
+    size_t mN;
+  };
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, mCount); }
+
+private:
+  uint64_t offset(size_t n) const;
+
+  MappedFile mFile;
+  std::vector<char> mFallback;               // file contents if mmap unavailable
+  const char* mpBase;                        // start of file contents
+  size_t mFileSize;
+  uint64_t mRecordsEnd;                      // offset after last record (start of index)
+  const char* mpIndex;                       // trailing index in file (NULL if recovered)
+  std::vector<uint64_t> mScanned;            // offsets rebuilt by scanning
+  size_t mCount;
+  bool mRecovered;
+};
+
+}; //end namespace codepi
@@ -17,117 +17,1239 @@
 
 #include "Serialator.h"
 #include <fstream>
-#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+#include <cerrno>
+#ifdef SERIALATOR_CXX17
+#include <charconv>
+#endif
+#ifdef SERIALATOR_PROFILE
+#include <mutex>
+#include <typeindex>
+#ifdef __GNUG__
+#include <cxxabi.h>
+#endif
+#endif
+
+// SIMD and CRC instructions: x86 ones are compiled per function and picked at run
+// time, ARM ones are used when the compiler targets them
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define SERIALATOR_X86 1
+#define SERIALATOR_TARGET(isa) __attribute__((target(isa)))
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define SERIALATOR_X86 1
+#define SERIALATOR_TARGET(isa)
+#else
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define SERIALATOR_CRC_ARM 1
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SERIALATOR_NEON 1
+#endif
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define SERIALATOR_HAS_MMAP 1
+#endif
 
 namespace codepi{
 
 using namespace std;
 
+///////////////////////////////////////////////////////////////////////////////////////////
+// TextNumber method implementations
+
+#ifdef __cpp_lib_to_chars  // C++17 library with floating point to_chars/from_chars
+
+template <typename T>
+static size_t toChars(char* buf, T v){
+  return to_chars(buf, buf+TextNumber::MAX_CHARS, v).ptr - buf; // shortest round trip
+}
+
+template <typename T>
+static bool fromChars(const char* first, const char* last, T& v){
+  from_chars_result r = from_chars(first, last, v);
+  return r.ec==errc() && r.ptr==last;
+}
+
+size_t TextNumber::format(char* buf, long long v)          { return toChars(buf, v); }
+size_t TextNumber::format(char* buf, unsigned long long v) { return toChars(buf, v); }
+size_t TextNumber::format(char* buf, float v)              { return toChars(buf, v); }
+size_t TextNumber::format(char* buf, double v)             { return toChars(buf, v); }
+size_t TextNumber::format(char* buf, long double v)        { return toChars(buf, v); }
+
+bool TextNumber::parse(const char* first, const char* last, long long& v)          { return fromChars(first, last, v); }
+bool TextNumber::parse(const char* first, const char* last, unsigned long long& v) { return fromChars(first, last, v); }
+bool TextNumber::parse(const char* first, const char* last, float& v)              { return fromChars(first, last, v); }
+bool TextNumber::parse(const char* first, const char* last, double& v)             { return fromChars(first, last, v); }
+bool TextNumber::parse(const char* first, const char* last, long double& v)        { return fromChars(first, last, v); }
+
+#else // snprintf/strto* fallback, same output as operator<< with default flags
+
+size_t TextNumber::format(char* buf, long long v)          { return snprintf(buf, MAX_CHARS, "%lld", v); }
+size_t TextNumber::format(char* buf, unsigned long long v) { return snprintf(buf, MAX_CHARS, "%llu", v); }
+size_t TextNumber::format(char* buf, float v)              { return snprintf(buf, MAX_CHARS, "%g", double(v)); }
+size_t TextNumber::format(char* buf, double v)             { return snprintf(buf, MAX_CHARS, "%g", v); }
+size_t TextNumber::format(char* buf, long double v)        { return snprintf(buf, MAX_CHARS, "%Lg", v); }
+
+// copy [first,last) to a terminated string, parse with fn and check everything was used
+template <typename T, typename Fn>
+static bool strParse(const char* first, const char* last, T& v, Fn fn){
+  char str[TextNumber::MAX_CHARS+1];
+  size_t n = last - first;
+  if(n==0 || n>TextNumber::MAX_CHARS) return false;
+  memcpy(str, first, n);
+  str[n] = 0;
+  char* end;
+  errno = 0;
+  v = fn(str, &end);
+  return errno==0 && end==str+n;
+}
+
+static long long          strToLL (const char* s, char** e){ return strtoll(s, e, 10); }
+static unsigned long long strToULL(const char* s, char** e){
+  if(*s=='-'){ *e = (char*)s; return 0; }  // strtoull would accept and negate it
+  return strtoull(s, e, 10);
+}
+
+bool TextNumber::parse(const char* first, const char* last, long long& v)          { return strParse(first, last, v, strToLL); }
+bool TextNumber::parse(const char* first, const char* last, unsigned long long& v) { return strParse(first, last, v, strToULL); }
+bool TextNumber::parse(const char* first, const char* last, float& v)              { return strParse(first, last, v, strtof); }
+bool TextNumber::parse(const char* first, const char* last, double& v)             { return strParse(first, last, v, strtod); }
+bool TextNumber::parse(const char* first, const char* last, long double& v)        { return strParse(first, last, v, strtold); }
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// BufferWriter method implementations
+
+BufferWriter::BufferWriter(vector<char>& vec, size_t capacityHint)
+  : mpVec(&vec), mStart(vec.size()), mpSink(NULL), mDrained(0), mChecked(false), mCrc(0), mCrcStart(0), mCrcDone(0){
+    vec.resize(max(vec.capacity(), mStart+capacityHint)); // use existing capacity first
+    mpBegin = mpCur = vec.empty() ? NULL : &vec[0] + mStart;
+    mpEnd = mpLimit = vec.empty() ? NULL : &vec[0] + vec.size();
+}
+
+void BufferWriter::grow(size_t n, const char* errMsg){
+  if(!mpVec) throw runtime_error(errMsg);
+  size_t used = sizeUsed();
+  size_t needed = mStart + used + n;
+  mpVec->resize(max(max(needed, mpVec->size()*2), size_t(256))); // geometric growth
+  mpBegin = &(*mpVec)[0] + mStart;
+  mpCur   = mpBegin + used;
+  mpEnd   = &(*mpVec)[0] + mpVec->size();
+}
+
+void BufferWriter::writeSlow(const void* src, size_t n, const char* errMsg){
+  if(mChecked) foldCrc();
+  if(n <= size_t(mpEnd-mpCur) || !mpSink){ // only the CRC chunk was full, or growable/fixed
+    if(n > size_t(mpEnd-mpCur)) grow(n, errMsg);
+    memcpy(mpCur, src, n);
+    mpCur += n;
+  }else{
+    const char* p = (const char*)src;
+    while(n>0){                            // fill and drain whole blocks
+      if(mpCur==mpEnd){
+        if(mChecked) foldCrc();
+        mpSink->drain(mpBegin, sizeUsed());
+        mDrained += sizeUsed();
+        char* next = mpSink->nextBlock(mpBegin);
+        mpEnd = next + (mpEnd - mpBegin);
+        mpBegin = mpCur = next;
+        mCrcDone = 0;
+      }
+      size_t chunk = min(n, size_t(mpEnd-mpCur));
+      memcpy(mpCur, p, chunk);
+      mpCur += chunk;
+      p += chunk;
+      n -= chunk;
+    }
+  }
+  updateLimit();
+}
+
+void BufferWriter::finish(){
+  if(mpSink){
+    if(mChecked) foldCrc();
+    if(sizeUsed()>0) mpSink->drain(mpBegin, sizeUsed());
+    mDrained += sizeUsed();
+    mpCur = mpBegin;
+    mCrcDone = 0;
+    updateLimit();
+  }
+  else if(mpVec) mpVec->resize(mStart + sizeUsed());
+}
+
+static const size_t CRC_CHUNK = 16384;     // bytes between CRC folds, still in L1 when folded
+
+void BufferWriter::beginCrc(){
+  mChecked = true;
+  mCrc = 0;
+  mCrcStart = mCrcDone = sizeUsed();
+  updateLimit();
+}
+
+uint32_t BufferWriter::crc(){
+  foldCrc();
+  return mCrc;
+}
+
+void BufferWriter::foldCrc(){
+  mCrc = Crc32c::extend(mCrc, mpBegin + mCrcDone, sizeUsed() - mCrcDone);
+  mCrcDone = sizeUsed();
+}
+
+void BufferWriter::updateLimit(){
+  mpLimit = mpEnd;
+  if(mChecked && size_t(mpEnd - mpBegin) - mCrcDone > CRC_CHUNK) 
+    mpLimit = max(mpCur, mpBegin + mCrcDone + CRC_CHUNK);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// ByteOrder method implementations
+//   The SIMD kernels reverse each size byte element of whole vectors of bytes with a
+//   byte shuffle and return how many bytes they did, the scalar loop does the rest.
+
+#if SERIALATOR_X86
+// run time CPU feature checks
+static bool hasSse42(){
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  return (info[2] & (1<<20)) != 0;
+#else
+  return __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+static bool hasAvx2(){
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  if(!(info[2] & (1<<27)) || (_xgetbv(0) & 6) != 6) return false; // OS saves ymm state
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1<<5)) != 0;
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static bool hasSsse3(){
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  return (info[2] & (1<<9)) != 0;
+#else
+  return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+// shuffle control reversing each size byte group of a 32 byte vector
+static void swapMask(char* mask, size_t size){
+  for(size_t j=0; j<32; j++) mask[j] = char((j % 16)/size*size + size-1 - j%size);
+}
+
+SERIALATOR_TARGET("ssse3")
+static size_t swapSsse3(char* dst, const char* src, size_t bytes, size_t size){
+  char m[32];
+  swapMask(m, size);
+  __m128i mask = _mm_loadu_si128((const __m128i*)m);
+  size_t i = 0;
+  for(; i+16<=bytes; i+=16){
+    __m128i v = _mm_loadu_si128((const __m128i*)(src+i));
+    _mm_storeu_si128((__m128i*)(dst+i), _mm_shuffle_epi8(v, mask));
+  }
+  return i;
+}
+
+SERIALATOR_TARGET("avx2")
+static size_t swapAvx2(char* dst, const char* src, size_t bytes, size_t size){
+  char m[32];
+  swapMask(m, size);
+  __m256i mask = _mm256_loadu_si256((const __m256i*)m);
+  size_t i = 0;
+  for(; i+64<=bytes; i+=64){                 // two vectors per iteration
+    __m256i a = _mm256_loadu_si256((const __m256i*)(src+i));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(src+i+32));
+    _mm256_storeu_si256((__m256i*)(dst+i), _mm256_shuffle_epi8(a, mask));
+    _mm256_storeu_si256((__m256i*)(dst+i+32), _mm256_shuffle_epi8(b, mask));
+  }
+  for(; i+32<=bytes; i+=32){
+    __m256i v = _mm256_loadu_si256((const __m256i*)(src+i));
+    _mm256_storeu_si256((__m256i*)(dst+i), _mm256_shuffle_epi8(v, mask));
+  }
+  return i;
+}
+
+#elif SERIALATOR_NEON
+static size_t swapNeon(char* dst, const char* src, size_t bytes, size_t size){
+  size_t i = 0;
+  for(; i+16<=bytes; i+=16){
+    uint8x16_t v = vld1q_u8((const uint8_t*)(src+i));
+    v = size==2 ? vrev16q_u8(v) : size==4 ? vrev32q_u8(v) : vrev64q_u8(v);
+    vst1q_u8((uint8_t*)(dst+i), v);
+  }
+  return i;
+}
+#endif
+
+void ByteOrder::swapArray(void* dst, const void* src, size_t n, size_t size){
+  char* d = (char*)dst;
+  const char* s = (const char*)src;
+  size_t bytes = n*size, done = 0;
+  if(size==2 || size==4 || size==8){
+#if SERIALATOR_X86
+    static const int level = hasAvx2() ? 2 : hasSsse3() ? 1 : 0;
+    if(level==2) done = swapAvx2(d, s, bytes, size);
+    else if(level==1) done = swapSsse3(d, s, bytes, size);
+#elif SERIALATOR_NEON
+    done = swapNeon(d, s, bytes, size);
+#endif
+  }
+  swapElements(d+done, s+done, (bytes-done)/size, size);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// Crc32c method implementations
+
+// slicing-by-8 tables, entry[k][b] is the CRC of byte b followed by k zero bytes
+struct Crc32cTables{
+  uint32_t entry[8][256];
+  Crc32cTables(){
+    for(uint32_t i=0; i<256; i++){
+      uint32_t c = i;
+      for(int k=0; k<8; k++) c = (c & 1) ? (c >> 1) ^ 0x82F63B78 : c >> 1;
+      entry[0][i] = c;
+    }
+    for(uint32_t i=0; i<256; i++)
+      for(int k=1; k<8; k++) entry[k][i] = (entry[k-1][i] >> 8) ^ entry[0][entry[k-1][i] & 0xff];
+  }
+};
+
+static uint32_t crc32cPortable(uint32_t crc, const uint8_t* p, size_t n){
+  static const Crc32cTables tables;
+  const uint32_t (*t)[256] = tables.entry;
+  for(; n>0 && (size_t(p) & 7); n--) crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  for(; n>=8; n-=8, p+=8){
+    uint32_t lo, hi;
+    memcpy(&lo, p, 4);
+    memcpy(&hi, p+4, 4);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_BIG_ENDIAN__
+    lo = (lo>>24) | ((lo>>8)&0xff00) | ((lo<<8)&0xff0000) | (lo<<24);
+    hi = (hi>>24) | ((hi>>8)&0xff00) | ((hi<<8)&0xff0000) | (hi<<24);
+#endif
+    lo ^= crc;
+    crc = t[7][lo & 0xff] ^ t[6][(lo>>8) & 0xff] ^ t[5][(lo>>16) & 0xff] ^ t[4][lo>>24] ^
+          t[3][hi & 0xff] ^ t[2][(hi>>8) & 0xff] ^ t[1][(hi>>16) & 0xff] ^ t[0][hi>>24];
+  }
+  for(; n>0; n--) crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+// a*b mod P with the bit reflected polynomial representation (x^0 is the top bit)
+static uint32_t crc32cMulMod(uint32_t a, uint32_t b){
+  uint32_t prod = 0;
+  for(uint32_t m = 0x80000000; m; m >>= 1){
+    if(a & m) prod ^= b;
+    b = (b & 1) ? (b >> 1) ^ 0x82F63B78 : b >> 1;
+  }
+  return prod;
+}
+
+// x^(8n) mod P, multiplying a CRC register by it appends n zero bytes
+static uint32_t crc32cZeros(size_t n){
+  uint32_t result = 0x80000000, sq = 0x40000000;  // x^0, x^1
+  for(uint64_t e = uint64_t(n)*8; e; e >>= 1){
+    if(e & 1) result = crc32cMulMod(result, sq);
+    sq = crc32cMulMod(sq, sq);
+  }
+  return result;
+}
+
+#if SERIALATOR_X86
+static const size_t CRC_LANE = 4096;       // bytes per interleaved stream
+
+// table form of multiplying by crc32cZeros(CRC_LANE), one lookup per register byte
+struct Crc32cLaneShift{
+  uint32_t entry[4][256];
+  Crc32cLaneShift(){
+    uint32_t zeros = crc32cZeros(CRC_LANE);
+    for(uint32_t i=0; i<256; i++)
+      for(int k=0; k<4; k++) entry[k][i] = crc32cMulMod(zeros, i << (8*k));
+  }
+  uint32_t operator()(uint32_t crc) const {
+    return entry[0][crc & 0xff] ^ entry[1][(crc>>8) & 0xff] ^ 
+           entry[2][(crc>>16) & 0xff] ^ entry[3][crc>>24];
+  }
+};
+
+SERIALATOR_TARGET("sse4.2")
+static uint32_t crc32cHardware(uint32_t crc, const uint8_t* p, size_t n){
+  for(; n>0 && (size_t(p) & 7); n--) crc = _mm_crc32_u8(crc, *p++);
+#if defined(__x86_64__) || defined(_M_X64)
+  // crc32 has 3 cycle latency and 1 cycle throughput, so run three streams side
+  // by side and join them by shifting the earlier ones over the later bytes
+  static const Crc32cLaneShift laneShift;
+  for(; n>=3*CRC_LANE; n-=3*CRC_LANE, p+=3*CRC_LANE){
+    uint64_t a = crc, b = 0, c = 0;
+    for(size_t i=0; i<CRC_LANE; i+=8){
+      uint64_t va, vb, vc;
+      memcpy(&va, p+i, 8);
+      memcpy(&vb, p+CRC_LANE+i, 8);
+      memcpy(&vc, p+2*CRC_LANE+i, 8);
+      a = _mm_crc32_u64(a, va);
+      b = _mm_crc32_u64(b, vb);
+      c = _mm_crc32_u64(c, vc);
+    }
+    crc = laneShift(laneShift(uint32_t(a)) ^ uint32_t(b)) ^ uint32_t(c);
+  }
+  uint64_t c64 = crc;
+  for(; n>=8; n-=8, p+=8){
+    uint64_t v;
+    memcpy(&v, p, 8);
+    c64 = _mm_crc32_u64(c64, v);
+  }
+  crc = uint32_t(c64);
+#endif
+  for(; n>=4; n-=4, p+=4){
+    uint32_t v;
+    memcpy(&v, p, 4);
+    crc = _mm_crc32_u32(crc, v);
+  }
+  for(; n>0; n--) crc = _mm_crc32_u8(crc, *p++);
+  return crc;
+}
+
+#elif SERIALATOR_CRC_ARM
+static uint32_t crc32cHardware(uint32_t crc, const uint8_t* p, size_t n){
+  for(; n>0 && (size_t(p) & 7); n--) crc = __crc32cb(crc, *p++);
+  for(; n>=8; n-=8, p+=8){
+    uint64_t v;
+    memcpy(&v, p, 8);
+    crc = __crc32cd(crc, v);
+  }
+  for(; n>0; n--) crc = __crc32cb(crc, *p++);
+  return crc;
+}
+#endif
+
+uint32_t Crc32c::extend(uint32_t crc, const void* data, size_t n){
+  typedef uint32_t (*CrcFn)(uint32_t, const uint8_t*, size_t);
+#if SERIALATOR_X86
+  static const CrcFn impl = hasSse42() ? crc32cHardware : crc32cPortable;
+#elif SERIALATOR_CRC_ARM
+  static const CrcFn impl = crc32cHardware;
+#else
+  static const CrcFn impl = crc32cPortable;
+#endif
+  return ~impl(~crc, (const uint8_t*)data, n);
+}
+
+// BufferWriter::patch is here for the CRC helpers.  The CRC register is linear in the
+// data, so patching bytes already folded changes it by the register of (old xor new),
+// moved past the bytes folded after the patch by multiplying with x^(8*bytes).
+void BufferWriter::patch(size_t offset, const void* src, size_t n){
+  size_t lo = max(offset, mCrcStart), hi = min(offset+n, mCrcDone);
+  if(mChecked && lo < hi){
+    uint32_t reg = 0;
+    uint8_t diff[64];
+    for(size_t i=lo; i<hi; i+=sizeof(diff)){
+      size_t m = min(sizeof(diff), hi-i);
+      for(size_t j=0; j<m; j++) diff[j] = uint8_t(mpBegin[i+j] ^ ((const char*)src)[i-offset+j]);
+      reg = ~Crc32c::extend(~reg, diff, m);
+    }
+    mCrc ^= crc32cMulMod(reg, crc32cZeros(mCrcDone-hi));
+  }
+  memcpy(mpBegin + offset, src, n);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// Xxh64 method implementations
+
+static const uint64_t XXH_PRIME1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t XXH_PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t XXH_PRIME3 = 0x165667B19E3779F9ULL;
+static const uint64_t XXH_PRIME4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t XXH_PRIME5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t rotl64(uint64_t x, int r){ return (x << r) | (x >> (64 - r)); }
+
+// XXH64 reads its input as little endian words
+static inline uint64_t xxhLoad64(const char* p){
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return ByteOrder::HOST_BIG ? ByteOrder::swap(v) : v;
+}
+static inline uint32_t xxhLoad32(const char* p){
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return ByteOrder::HOST_BIG ? ByteOrder::swap(v) : v;
+}
+
+static inline uint64_t xxhRound(uint64_t acc, uint64_t input){
+  acc += input * XXH_PRIME2;
+#if defined(__GNUC__)
+  __asm__("" : "+r" (acc));   // keep the lanes scalar, vectorized 64 bit multiplies are slower
+#endif
+  return rotl64(acc, 31) * XXH_PRIME1;
+}
+
+static inline uint64_t xxhMerge(uint64_t acc, uint64_t lane){
+  return (acc ^ xxhRound(0, lane)) * XXH_PRIME1 + XXH_PRIME4;
+}
+
+// hash whole stripes from p, returns the bytes consumed
+static size_t xxhStripes(uint64_t* lanes, const char* p, size_t n){
+  uint64_t v1 = lanes[0], v2 = lanes[1], v3 = lanes[2], v4 = lanes[3];
+  const char* start = p;
+  for(; n >= 32; p += 32, n -= 32){
+    v1 = xxhRound(v1, xxhLoad64(p));
+    v2 = xxhRound(v2, xxhLoad64(p+8));
+    v3 = xxhRound(v3, xxhLoad64(p+16));
+    v4 = xxhRound(v4, xxhLoad64(p+24));
+  }
+  lanes[0] = v1; lanes[1] = v2; lanes[2] = v3; lanes[3] = v4;
+  return p - start;
+}
+
+Xxh64::Xxh64(uint64_t seed) : mSeed(seed), mTotal(0), mTailSize(0){
+  mLanes[0] = seed + XXH_PRIME1 + XXH_PRIME2;
+  mLanes[1] = seed + XXH_PRIME2;
+  mLanes[2] = seed;
+  mLanes[3] = seed - XXH_PRIME1;
+}
+
+void Xxh64::update(const void* data, size_t n){
+  const char* p = (const char*)data;
+  mTotal += n;
+  if(mTailSize + n < 32){
+    memcpy(mTail + mTailSize, p, n);
+    mTailSize += n;
+    return;
+  }
+  if(mTailSize > 0){                       // complete the pending stripe
+    size_t fill = 32 - mTailSize;
+    memcpy(mTail + mTailSize, p, fill);
+    xxhStripes(mLanes, mTail, 32);
+    p += fill;
+    n -= fill;
+    mTailSize = 0;
+  }
+  size_t done = xxhStripes(mLanes, p, n);
+  mTailSize = n - done;
+  memcpy(mTail, p + done, mTailSize);
+}
+
+uint64_t Xxh64::digest() const{
+  uint64_t h;
+  if(mTotal >= 32){
+    h = rotl64(mLanes[0], 1) + rotl64(mLanes[1], 7) + rotl64(mLanes[2], 12) + rotl64(mLanes[3], 18);
+    for(int i=0; i<4; i++) h = xxhMerge(h, mLanes[i]);
+  }else{
+    h = mSeed + XXH_PRIME5;
+  }
+  h += mTotal;
+  const char* p = mTail;
+  size_t n = mTailSize;
+  for(; n >= 8; p += 8, n -= 8) h = rotl64(h ^ xxhRound(0, xxhLoad64(p)), 27) * XXH_PRIME1 + XXH_PRIME4;
+  if(n >= 4){
+    h = rotl64(h ^ (uint64_t(xxhLoad32(p)) * XXH_PRIME1), 23) * XXH_PRIME2 + XXH_PRIME3;
+    p += 4;
+    n -= 4;
+  }
+  for(; n > 0; p++, n--) h = rotl64(h ^ (uint8_t(*p) * XXH_PRIME5), 11) * XXH_PRIME1;
+  h ^= h >> 33;
+  h *= XXH_PRIME2;
+  h ^= h >> 29;
+  h *= XXH_PRIME3;
+  h ^= h >> 32;
+  return h;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// BlockCodec method implementations
+
+const uint32_t BlockCodec::MAGIC;
+const uint32_t BlockCodec::STORED;
+const size_t   BlockCodec::MAX_BLOCK;
+
+static const int    LZ_HASH_BITS  = 14;
+static const size_t LZ_MIN_MATCH  = 4;
+static const size_t LZ_MAX_OFFSET = 65535;
+static const size_t LZ_LAST_LITERALS = 5;  // block always ends with a few literals
+
+static uint32_t load32(const char* p){ uint32_t v; memcpy(&v, p, 4); return v; }
+static uint64_t load64(const char* p){ uint64_t v; memcpy(&v, p, 8); return v; }
+
+static uint32_t lzHash(const char* p){
+  return (load32(p) * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// extra length bytes for a literal or match count of 15 or more
+static char* lzWriteLength(char* op, size_t len){
+  for(len -= 15; len >= 255; len -= 255) *op++ = char(255);
+  *op++ = char(len);
+  return op;
+}
+
+static bool lzReadLength(const uint8_t*& ip, const uint8_t* iend, size_t& len){
+  uint8_t b;
+  do{
+    if(ip==iend || len > BlockCodec::MAX_BLOCK) return false;
+    b = *ip++;
+    len += b;
+  }while(b==255);
+  return true;
+}
+
+// write one sequence, matchLen 0 for the final literals only sequence
+static char* lzSequence(char* op, const char* lit, size_t litLen, size_t offset, size_t matchLen){
+  uint8_t* token = (uint8_t*)op++;
+  *token = uint8_t(min(litLen, size_t(15)) << 4);
+  if(litLen >= 15) op = lzWriteLength(op, litLen);
+  memcpy(op, lit, litLen);
+  op += litLen;
+  if(matchLen){
+    op[0] = char(offset);
+    op[1] = char(offset >> 8);
+    op += 2;
+    size_t extra = matchLen - LZ_MIN_MATCH;
+    *token |= uint8_t(min(extra, size_t(15)));
+    if(extra >= 15) op = lzWriteLength(op, extra);
+  }
+  return op;
+}
+
+size_t BlockCodec::compressBlock(const char* src, size_t n, char* dst, int level){
+  if(level<=0 || n < 2*LZ_LAST_LITERALS + LZ_MIN_MATCH) return 0;
+  int depth = level<=1 ? 1 : 1 << (min(level, 9) - 1);  // candidates tried per position
+  mHead.assign(size_t(1) << LZ_HASH_BITS, 0);
+  if(depth>1 && mPrev.size()<n) mPrev.resize(n);
+
+  const char* ip = src;
+  const char* anchor = src;                // start of pending literals
+  const char* matchLimit = src + n - LZ_LAST_LITERALS;
+  char* op = dst;
+  size_t misses = 0;
+
+  while(ip + LZ_MIN_MATCH <= matchLimit){
+    uint32_t pos = uint32_t(ip - src);
+    uint32_t h = lzHash(ip);
+    uint32_t cand = mHead[h];              // position+1 of the last match candidate
+    mHead[h] = pos+1;
+    if(depth>1) mPrev[pos] = cand;
+
+    size_t bestLen = 0, bestOffset = 0;
+    for(int d=0; d<depth && cand; d++){
+      const char* m = src + cand-1;
+      if(size_t(ip-m) > LZ_MAX_OFFSET) break;
+      if(load32(m)==load32(ip)){
+        size_t len = LZ_MIN_MATCH;
+        while(ip+len+8 <= matchLimit && load64(m+len)==load64(ip+len)) len += 8;
+        while(ip+len < matchLimit && m[len]==ip[len]) len++;
+        if(len > bestLen){ bestLen = len; bestOffset = ip-m; }
+      }
+      if(depth>1) cand = mPrev[cand-1];
+    }
+
+    if(bestLen < LZ_MIN_MATCH){
+      ip += 1 + (level<=1 ? (misses++ >> 5) : 0);  // level 1 skips faster through noise
+      continue;
+    }
+
+    size_t litLen = ip - anchor;
+    if(size_t(op-dst) + litLen + litLen/255 + 8 > n) return 0;  // not shrinking
+    op = lzSequence(op, anchor, litLen, bestOffset, bestLen);
+
+    const char* matchEnd = ip + bestLen;
+    if(depth>1){                           // index positions inside the match
+      for(ip++; ip < matchEnd && ip + LZ_MIN_MATCH <= matchLimit; ip++){
+        uint32_t p = uint32_t(ip - src);
+        uint32_t hp = lzHash(ip);
+        mPrev[p] = mHead[hp];
+        mHead[hp] = p+1;
+      }
+    }
+    ip = anchor = matchEnd;
+    misses = 0;
+  }
+
+  size_t litLen = src + n - anchor;
+  if(size_t(op-dst) + litLen + litLen/255 + 2 >= n) return 0;
+  op = lzSequence(op, anchor, litLen, 0, 0);
+  return op - dst;
+}
+
+bool BlockCodec::blockHeader(const char* p, Block& block){
+  uint32_t stored = load32(p+4);
+  block.rawSize = load32(p);
+  block.storedSize = stored & ~STORED;
+  block.compressed = !(stored & STORED);
+  if(block.rawSize==0 && stored==0) return false;   // end marker
+  if(block.rawSize==0 || block.rawSize > MAX_BLOCK || 
+     (block.compressed ? block.storedSize==0 || block.storedSize >= block.rawSize 
+                       : block.storedSize != block.rawSize))
+    throw runtime_error("READ_BIN: compressed block header corrupt");
+  return true;
+}
+
+void BlockCodec::decompressBlock(const Block& block, char* dst){
+  if(!block.compressed){
+    memcpy(dst, block.data, block.rawSize);
+    return;
+  }
+  const char* errMsg = "READ_BIN: compressed block corrupt";
+  const uint8_t* ip = (const uint8_t*)block.data;
+  const uint8_t* iend = ip + block.storedSize;
+  char* op = dst;
+  char* oend = dst + block.rawSize;
+  while(ip < iend){
+    unsigned token = *ip++;
+    size_t litLen = token >> 4;
+    if(litLen==15 && !lzReadLength(ip, iend, litLen)) throw runtime_error(errMsg);
+    if(litLen > size_t(iend-ip) || litLen > size_t(oend-op)) throw runtime_error(errMsg);
+    memcpy(op, ip, litLen);
+    op += litLen;
+    ip += litLen;
+    if(ip==iend) break;                    // final sequence has no match
+
+    if(iend-ip < 2) throw runtime_error(errMsg);
+    size_t offset = ip[0] | (size_t(ip[1]) << 8);
+    ip += 2;
+    size_t matchLen = token & 15;
+    if(matchLen==15 && !lzReadLength(ip, iend, matchLen)) throw runtime_error(errMsg);
+    matchLen += LZ_MIN_MATCH;
+    if(offset==0 || offset > size_t(op-dst) || matchLen > size_t(oend-op)) 
+      throw runtime_error(errMsg);
+    const char* m = op - offset;
+    if(offset >= matchLen) memcpy(op, m, matchLen);
+    else for(size_t i=0; i<matchLen; i++) op[i] = m[i];  // overlapping repeat
+    op += matchLen;
+  }
+  if(op!=oend) throw runtime_error(errMsg);
+}
+
+size_t BlockCodec::scan(const char* data, size_t size, vector<Block>& blocks, size_t* used){
+  blocks.clear();
+  if(size<4 || load32(data)!=MAGIC) throw runtime_error("READ_BIN: not a compressed stream");
+  size_t pos = 4, rawSize = 0;
+  Block block;
+  while(true){
+    if(size-pos < 8) throw runtime_error("READ_BIN: compressed stream truncated");
+    bool more = blockHeader(data+pos, block);
+    pos += 8;
+    if(!more) break;
+    if(block.storedSize > size-pos) throw runtime_error("READ_BIN: compressed stream truncated");
+    block.data = data+pos;
+    block.rawOffset = rawSize;
+    blocks.push_back(block);
+    pos += block.storedSize;
+    rawSize += block.rawSize;
+  }
+  if(used) *used = pos;
+  return rawSize;
+}
+
+void BlockCodec::decompress(const char* data, size_t size, vector<char>& out){
+  vector<Block> blocks;
+  out.resize(scan(data, size, blocks));
+  for(size_t i=0; i<blocks.size(); i++) decompressBlock(blocks[i], &out[0] + blocks[i].rawOffset);
+}
+
 ////////////////////////////////////////////////////////
-// Helper class for wrapping a char* without copying
-// This allows use of a c-style array a streambuf
-// The streambuf can then be used in a istream or ostream
+// Sink compressing each drained block to a vector or ostream
 
-class StreambufWrapper : public streambuf {
+class CompressingSink : public BufferSink{
 public:
-  StreambufWrapper(char* s, std::size_t n) {
-    setg(s, s, s + n);  // set up as input buffer
-    setp(s, s + n);     // set up as output buffer
+  CompressingSink(int level, vector<char>* vec, ostream* os) 
+    : mLevel(level), mpVec(vec), mpOStream(os){
+    put(&BlockCodec::MAGIC, 4);
+  }
+
+  void drain(const char* data, size_t n){
+    mScratch.resize(n + 16);
+    size_t size = mCodec.compressBlock(data, n, &mScratch[0], mLevel);
+    uint32_t header[2] = { uint32_t(n), size ? uint32_t(size) : uint32_t(n) | BlockCodec::STORED };
+    put(header, sizeof(header));
+    if(size) put(&mScratch[0], size);
+    else put(data, n);
+  }
+
+  void close(){
+    uint32_t end[2] = { 0, 0 };
+    put(end, sizeof(end));
   }
-  size_t getSizeUsed(){
-    return pptr() - pbase();
+
+private:
+  void put(const void* data, size_t n){
+    if(mpVec) mpVec->insert(mpVec->end(), (const char*)data, (const char*)data + n);
+    else{
+      mpOStream->write((const char*)data, n);
+      if(mpOStream->fail()) throw runtime_error("WRITE_BIN: compressed write error");
+    }
   }
+
+  int mLevel;
+  vector<char>* mpVec;
+  ostream* mpOStream;
+  BlockCodec mCodec;
+  vector<char> mScratch;
 };
 
+///////////////////////////////////////////////////////////////////////////////////////////
+// MappedFile method implementations
+
+MappedFile::MappedFile(const std::string& filename) : mpData(NULL), mSize(0){
+#ifdef SERIALATOR_HAS_MMAP
+  int fd = open(filename.c_str(), O_RDONLY);
+  if(fd<0) return;
+  struct stat st;
+  if(fstat(fd, &st)==0 && st.st_size>0){
+    void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(p!=MAP_FAILED){
+      madvise(p, st.st_size, MADV_SEQUENTIAL);  // aggressive read-ahead
+      madvise(p, st.st_size, MADV_WILLNEED);    // start paging in now
+      mpData = (const char*)p;
+      mSize = st.st_size;
+    }
+  }
+  close(fd);  // mapping stays valid after close
+#endif
+}
+
+MappedFile::~MappedFile(){
+#ifdef SERIALATOR_HAS_MMAP
+  if(mpData) munmap((void*)mpData, mSize);
+#endif
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////
 // Archive method implementations
 
 // constructors
 Archive::Archive(ArchiveType type)                         
-  : mType(type), mpIStream(NULL), mpOStream(NULL), mSerializedSize(0){
-    if(type!=INIT && type!=SERIAL_SIZE_BIN){
+  : mType(type), mpIStream(NULL), mpOStream(NULL), mpReader(NULL), mpWriter(NULL), mSerializedSize(0), mFormat(BIN_DEFAULT), mpWalk(NULL){
+    if(type!=INIT && type!=SERIAL_SIZE_BIN && type!=RECORD && type!=CLONE && 
+       type!=COMPARE){
       throw runtime_error("Init/size Archive constructor is not compatible with type");
     }
 }
 
 Archive::Archive(ArchiveType type, istream& istream) 
-  : mType(type), mpIStream(&istream), mpOStream(NULL), mSerializedSize(0){
+  : mType(type), mpIStream(&istream), mpOStream(NULL), mpReader(NULL), mpWriter(NULL), mSerializedSize(0), mFormat(BIN_DEFAULT), mpWalk(NULL){
     if(type!=READ_BIN && type!=READ_TEXT){
       throw runtime_error("Read Archive constructor is not compatible with type");
     }
 }
 
 Archive::Archive(ArchiveType type, ostream& ostream) 
-  : mType(type), mpIStream(NULL), mpOStream(&ostream), mSerializedSize(0){
+  : mType(type), mpIStream(NULL), mpOStream(&ostream), mpReader(NULL), mpWriter(NULL), mSerializedSize(0), mFormat(BIN_DEFAULT), mpWalk(NULL){
     if(type!=WRITE_BIN && type!=WRITE_TEXT){
       throw runtime_error("Write Archive constructor is not compatible with type");
     }
 }
 
+Archive::Archive(ArchiveType type, BufferReader& reader) 
+  : mType(type), mpIStream(NULL), mpOStream(NULL), mpReader(&reader), mpWriter(NULL), mSerializedSize(0), mFormat(BIN_DEFAULT), mpWalk(NULL){
+    if(type!=READ_BIN && type!=READ_TEXT && type!=READ_DELTA){
+      throw runtime_error("Buffer read Archive constructor is not compatible with type");
+    }
+}
+
+Archive::Archive(ArchiveType type, BufferWriter& writer) 
+  : mType(type), mpIStream(NULL), mpOStream(NULL), mpReader(NULL), mpWriter(&writer), mSerializedSize(0), mFormat(BIN_DEFAULT), mpWalk(NULL){
+    if(type!=WRITE_BIN && type!=WRITE_TEXT && type!=WRITE_DELTA){
+      throw runtime_error("Buffer write Archive constructor is not compatible with type");
+    }
+}
+
 // operator& implementation for serializing and deserializing strings
 Archive& Archive::operator&(string& var){
-  uint32_t size;
+  stringHelper(var);
+  return *this;
+}
+
+#ifdef SERIALATOR_CXX17
+// operator& implementation for zero-copy string views
+Archive& Archive::operator&(string_view& var){
+  uint32_t size = var.size();
 
   switch(mType){
   case INIT:
-    var.clear();
+    var = string_view();
     break;
 
   case READ_BIN: 
-    (*this) & size;   // read string size from stream
-    var.resize(size); // resize string
-    if(size>0) mpIStream->read((char*)var.c_str(), size); // read string from stream
-    if(mpIStream->fail()) throw runtime_error("READ_BIN: string read error");
+    (*this) & size;   // read string size
+    var = string_view(viewBytes(size, false, "READ_BIN: string read error"), size);
     break; 
 
+  case READ_TEXT:
+    throw runtime_error("READ_TEXT: views cannot be deserialized from text");
+
   case WRITE_BIN: 
-    size = var.size();
-    (*this) & size;   // write string size to stream
-    if(size>0) mpOStream->write(var.c_str(), size); // write string to stream
-    if(mpOStream->fail()) throw runtime_error("WRITE_BIN: string write error");
+    (*this) & size;   // write string size
+    if(size>0) writeBin(var.data(), size, "WRITE_BIN: string write error");
     break; 
 
-  case READ_TEXT:
-    (*this) & size;   // read string size from stream
-    var.resize(size); // resize string
-    if(size>0) mpIStream->read((char*)var.c_str(), size);  // read string
-    mpIStream->ignore(); // skip past space
-    if(mpIStream->fail()) throw runtime_error("READ_TEXT: string read error");
-    break;
-
   case WRITE_TEXT:
-    size = var.size();
-    (*this) & size;   // write string size to stream
-    *mpOStream << var << " ";  // output string and space
-    if(mpOStream->fail()) throw runtime_error("WRITE_TEXT: string read error");
+    (*this) & size;   // write string size
+    if(size>0) writeBin(var.data(), size, "WRITE_TEXT: string write error"); // output string
+    writeBin(" ", 1, "WRITE_TEXT: string write error");                      // and space
     break;
 
   case SERIAL_SIZE_BIN:
-    mSerializedSize += sizeof(size) + var.size();
+    (*this) & size;   // size of string size
+    mSerializedSize += size;
+    break;
+
+  case RECORD:
+  case WRITE_DELTA:
+  case READ_DELTA:
+  case CLONE:
+  case COMPARE:
+    walkField(var);
     break;
 
   default: 
-    throw runtime_error("string operator& switch hit default.  Code error"); 
+    throw runtime_error("string_view operator& switch hit default.  Code error"); 
     break;
 
   };
   return *this;
 }
+#endif
 
 // operator& for serializing and deserializing descendants of Serialator
 Archive& Archive::operator& (Serialator& ser){
+  if(walking()){                    // nested objects start walks of their own
+    walkField(ser);
+    return *this;
+  }
+  SERIALATOR_PROFILE_SCOPE(ser);
   int32_t version = ser.getStructVersion();
   if(mType!=INIT) *this & version;  // read or write version number (if not init)
+  if(framed() && mType==WRITE_BIN) writeFramed(ser, version);
+  else if(framed() && mType==READ_BIN) readFramed(ser, version);
+  else{
+    if(framed() && mType==SERIAL_SIZE_BIN) mSerializedSize += 4;
+    ser.archive(*this, version);
+  }
+  return *this;
+}
+
+// read n bytes from is into buf, growing it as data arrives so that a corrupt length
+// can't force a huge allocation
+static void readChunked(istream& is, vector<char>& buf, uint64_t n, const char* errMsg){
+  uint64_t end = buf.size() + n;
+  while(buf.size() < end){
+    size_t chunk = size_t(min(end - buf.size(), uint64_t(1)<<20));
+    size_t at = buf.size();
+    buf.resize(at + chunk);
+    is.read(&buf[at], chunk);
+    if(is.fail()) throw runtime_error(errMsg);
+  }
+}
+
+// The length is reserved and backpatched once the fields are written.  A stream can't 
+// be patched, so there the object is framed in memory and its nested objects patched.
+void Archive::writeFramed(Serialator& ser, int32_t version){
+  uint32_t length = 0;
+  if(!mpWriter || mpWriter->streaming()){  // length can't be patched, frame in memory
+    vector<char> frame;
+    BufferWriter bw(frame);
+    Archive ar(WRITE_BIN, bw);
+    ar.mFormat = mFormat;
+    ser.archive(ar, version);
+    bw.finish();
+    length = uint32_t(frame.size());
+    if(length!=frame.size()) throw runtime_error("WRITE_BIN: framed object too large");
+    writeFixed(length, "WRITE_BIN: framed write error");
+    if(!frame.empty()) writeBin(&frame[0], frame.size(), "WRITE_BIN: framed write error");
+    return;
+  }
+  size_t at = mpWriter->sizeUsed();
+  writeBin(&length, 4, "WRITE_BIN: framed write error");
+  ser.archive(*this, version);
+  size_t size = mpWriter->sizeUsed() - at - 4;
+  length = uint32_t(size);
+  if(length!=size) throw runtime_error("WRITE_BIN: framed object too large");
+  if(swapBytes()) length = ByteOrder::swap(length);
+  mpWriter->patch(at, &length, 4);
+}
+
+// Reading is bounded by the frame, so fields missing from an older writer's object
+// throw instead of reading into the next one, and fields this reader doesn't know are
+// skipped.  From a stream the frame is read into memory first.
+void Archive::readFramed(Serialator& ser, int32_t version){
+  uint32_t length;
+  readFixed(length, "READ_BIN: framed read error");
+  if(!mpReader){
+    vector<char> frame;
+    readChunked(*mpIStream, frame, length, "READ_BIN: framed object truncated");
+    const char* p = frame.empty() ? NULL : &frame[0];
+    BufferReader br(p, p+frame.size(), true);
+    Archive ar(READ_BIN, br);
+    ar.mFormat = mFormat;
+    ser.archive(ar, version);
+    return;
+  }
+  const char* end = mpReader->narrow(length, "READ_BIN: framed object truncated");
   ser.archive(*this, version);
+  mpReader->widen(end);
+}
+
+// operator& for lazily decoded nested objects (see Lazy)
+Archive& Archive::operator& (LazyBase& lazy){
+  Serialator& ser = lazy.value();
+  // recorded bytes can be copied as they are if only non-wire options differ
+  bool verbatim = lazy.pending() && 
+    ((lazy.mFormat ^ mFormat) & ~(BIN_REUSE | BIN_CHECKED))==0;
+  int32_t version = verbatim ? lazy.mVersion : ser.getStructVersion();
+  switch(mType){
+  case READ_BIN:
+    lazy.discard();
+    *this & version;
+    if(!mpReader || mpReader->transient()){
+      readFramed(ser, version);
+      break;
+    }
+    readFixed(lazy.mSize, "READ_BIN: lazy read error");
+    lazy.mpData = mpReader->take(lazy.mSize, "READ_BIN: lazy object truncated");
+    lazy.mVersion = version;
+    lazy.mFormat = mFormat;
+    break;
+  case WRITE_BIN:
+    if(!verbatim){
+      if(lazy.pending()) lazy.decode();
+      *this & version;
+      writeFramed(ser, version);
+      break;
+    }
+    *this & version;
+    writeFixed(lazy.mSize, "WRITE_BIN: lazy write error");
+    writeBin(lazy.mpData, lazy.mSize, "WRITE_BIN: lazy write error");
+    break;
+  case SERIAL_SIZE_BIN:
+    if(lazy.pending() && !verbatim) lazy.decode();
+    *this & version;
+    mSerializedSize += 4;
+    if(verbatim) mSerializedSize += lazy.mSize;
+    else ser.archive(*this, version);
+    break;
+  case INIT:
+    lazy.discard();
+    *this & ser;
+    break;
+  default:                          // text and delta walks see the decoded object
+    if(lazy.pending()) lazy.decode();
+    *this & ser;
+    break;
+  }
   return *this;
 }
 
+void LazyBase::decode(){
+  BufferReader br(mpData, mpData + mSize);
+  mpData = NULL;
+  Archive ar(Archive::READ_BIN, br);
+  ar.mFormat = mFormat;
+  value().archive(ar, mVersion);
+}
+
+// delta of a nested object: record the baseline's fields, then walk var against them
+bool Archive::deltaValue(Serialator& var, Serialator& base){
+  if(typeid(var)!=typeid(base)) throw runtime_error("WRITE_DELTA: baseline is a different type");
+  Walk walk(mpWalk->fields);
+  Archive record(RECORD);
+  record.mpWalk = &walk;
+  base.archive(record, base.getStructVersion());
+  Archive ar(WRITE_DELTA, *mpWriter);
+  ar.mpWalk = &walk;
+  var.archive(ar, var.getStructVersion());
+  if(walk.next!=walk.fields->size()) 
+    throw runtime_error("WRITE_DELTA: baseline does not match object layout");
+  walk.fields->resize(walk.first);          // pop this object's fields
+  writeDeltaVarint(0);
+  return walk.changed;
+}
+
+void Archive::applyDelta(Serialator& var){
+  Walk walk;
+  Archive ar(READ_DELTA, *mpReader);
+  ar.mpWalk = &walk;
+  readGap(walk);
+  var.archive(ar, var.getStructVersion());
+  if(!walk.done) throw runtime_error("READ_DELTA: delta does not match object layout");
+}
+
+// copy of a nested object: record the source's fields, then walk var copying each one
+void Archive::cloneValue(Serialator& var, Serialator& base){
+  if(&var==&base) return;
+  if(typeid(var)!=typeid(base)) throw runtime_error("CLONE: source is a different type");
+  Walk walk(mpWalk->fields);
+  Archive record(RECORD);
+  record.mpWalk = &walk;
+  base.archive(record, base.getStructVersion());
+  Archive ar(CLONE);
+  ar.mpWalk = &walk;
+  var.archive(ar, var.getStructVersion());
+  if(walk.next!=walk.fields->size()) 
+    throw runtime_error("CLONE: source does not match object layout");
+  walk.fields->resize(walk.first);          // pop this object's fields
+}
+
+// comparison of a nested object: record base's fields, then walk var comparing them
+bool Archive::compareValue(Serialator& var, Serialator& base){
+  if(&var==&base) return true;
+  if(typeid(var)!=typeid(base)) return false;
+  Walk walk(mpWalk->fields);
+  walk.path = mpWalk->path;
+  Archive record(RECORD);
+  record.mpWalk = &walk;
+  base.archive(record, base.getStructVersion());
+  Archive ar(COMPARE);
+  ar.mpWalk = &walk;
+  var.archive(ar, var.getStructVersion());
+  if(!walk.changed && walk.next!=walk.fields->size()){  // base has more fields
+    walk.changed = true;
+    ar.prependPath(to_string((unsigned long long)(walk.next - walk.first)));
+  }
+  walk.fields->resize(walk.first);          // pop this object's fields
+  return !walk.changed;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// StaticArchive adapters
+//   Default Serialator::archiveStatic implementations wrap the StaticArchive's backend 
+//   in a runtime Archive and call the classic archive(Archive&,int32_t) method.
+
+void Serialator::archiveStatic(InitArchive&, int32_t structVersion){
+  Archive ar(Archive::INIT);
+  archive(ar, structVersion);
+}
+
+void Serialator::archiveStatic(BinReadArchive& sar, int32_t structVersion){
+  Archive ar(Archive::READ_BIN, *sar.mpReader);
+  archive(ar, structVersion);
+}
+
+void Serialator::archiveStatic(BinWriteArchive& sar, int32_t structVersion){
+  Archive ar(Archive::WRITE_BIN, *sar.mpWriter);
+  archive(ar, structVersion);
+}
+
+void Serialator::archiveStatic(BinSizeArchive& sar, int32_t structVersion){
+  Archive ar(Archive::SERIAL_SIZE_BIN);
+  archive(ar, structVersion);
+  sar.mSerializedSize += ar.mSerializedSize;
+}
+
+#ifdef SERIALATOR_PROFILE
+///////////////////////////////////////////////////////////////////////////////////////////
+// Profiler method implementations
+
+namespace{
+
+struct ProfileTotals{
+  uint64_t calls, bytes, nanos;
+};
+
+typedef pair<int,type_index> ProfileKey;
+
+struct ProfileRegistry{
+  mutex m;
+  map<ProfileKey,ProfileTotals> totals;
+};
+
+ProfileRegistry& profileRegistry(){
+  static ProfileRegistry registry;
+  return registry;
+}
+
+string typeName(const type_index& type){
+#ifdef __GNUG__
+  int status;
+  char* name = abi::__cxa_demangle(type.name(), NULL, NULL, &status);
+  if(name){
+    string result(name);
+    free(name);
+    return result;
+  }
+#endif
+  return type.name();
+}
+
+bool moreTime(const ProfileEntry& a, const ProfileEntry& b){ return a.nanos > b.nanos; }
+
+}
+
+void Profiler::record(Archive::ArchiveType direction, const type_info& type, 
+                      uint64_t bytes, uint64_t nanos){
+  ProfileRegistry& registry = profileRegistry();
+  try{                                    // called from destructors, never throw
+    lock_guard<mutex> lock(registry.m);
+    ProfileTotals& t = registry.totals.insert(make_pair(ProfileKey(direction, type_index(type)), 
+                                                        ProfileTotals())).first->second;
+    t.calls++;
+    t.bytes += bytes;
+    t.nanos += nanos;
+  }catch(...){}
+}
+
+vector<ProfileEntry> Profiler::report(){
+  ProfileRegistry& registry = profileRegistry();
+  vector<ProfileEntry> entries;
+  {
+    lock_guard<mutex> lock(registry.m);
+    for(map<ProfileKey,ProfileTotals>::iterator i=registry.totals.begin(); i!=registry.totals.end(); i++){
+      ProfileEntry e = { Archive::ArchiveType(i->first.first), string(), 
+                         i->second.calls, i->second.bytes, i->second.nanos };
+      e.type = typeName(i->first.second);
+      entries.push_back(e);
+    }
+  }
+  sort(entries.begin(), entries.end(), moreTime);
+  return entries;
+}
+
+void Profiler::print(ostream& os){
+  static const char* names[] = { "INIT", "READ_BIN", "WRITE_BIN", "READ_TEXT", "WRITE_TEXT",
+                                 "SERIAL_SIZE_BIN", "RECORD", "WRITE_DELTA", "READ_DELTA",
+                                 "CLONE", "COMPARE" };
+  vector<ProfileEntry> entries = report();
+  char line[128];
+  snprintf(line, sizeof(line), "%-16s %12s %14s %12s  %s\n", "direction", "calls", "bytes", "ms", "type");
+  os << line;
+  for(size_t i=0; i<entries.size(); i++){
+    snprintf(line, sizeof(line), "%-16s %12llu %14llu %12.3f  ", names[entries[i].direction], 
+             (unsigned long long)entries[i].calls, (unsigned long long)entries[i].bytes,
+             entries[i].nanos / 1e6);
+    os << line << entries[i].type << "\n";
+  }
+}
+
+void Profiler::reset(){
+  ProfileRegistry& registry = profileRegistry();
+  lock_guard<mutex> lock(registry.m);
+  registry.totals.clear();
+}
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////////////////
 // Serialization method implementations
 
 // init all elements to type default
 void Serialator::initAll(){ 
-  Archive ar(Archive::INIT);
+  InitArchive ar;
   ar & *this;
 }
 
@@ -160,31 +1282,31 @@ void Serialator::binDeserialize(std::istream&is){
 /////////////////////////////////////////
 
 int Serialator::textSerialize(char* blob, int maxBlobSize){
-  StreambufWrapper sb(blob, maxBlobSize); // create streambuf from blob without copying
-  ostream os(&sb);                        // wrap streambuf in ostream
-  textSerialize(os);                      // serialize to streambuf
-  int size = sb.getSizeUsed();            
-  if(size<maxBlobSize) blob[size]=0;      // add \0 if there is room
-  return size;                            // return used size
+  BufferWriter bw(blob, blob+maxBlobSize); // format directly into blob, no ostream
+  Archive ar(Archive::WRITE_TEXT,bw);
+  ar & *this;
+  int size = bw.sizeUsed();            
+  if(size<maxBlobSize) blob[size]=0;       // add \0 if there is room
+  return size;                             // return used size
 }
 
 void Serialator::textDeserialize(const char* blob, int blobSize){
-  StreambufWrapper sb((char*)blob, blobSize); // create streambuf from blob without copying
-  istream is(&sb);                            // wrap streambuf in istream
-  textDeserialize(is);                        // deserialize from streambuf
+  BufferReader br(blob, blob+blobSize);    // parse directly from blob, no istream
+  Archive ar(Archive::READ_TEXT,br);
+  ar & *this;
 }
 
 int Serialator::binSerialize(char* blob, int maxBlobSize){
-  StreambufWrapper sb(blob, maxBlobSize); // create streambuf from blob without copying
-  ostream os(&sb);                        // wrap streambuf in ostream
-  binSerialize(os);                       // serialize to streambuf
-  return sb.getSizeUsed();                // return used size
+  BufferWriter bw(blob, blob+maxBlobSize); // write directly into blob, no ostream
+  BinWriteArchive ar(bw);
+  ar & *this;
+  return bw.sizeUsed();                    // return used size
 }
 
 void Serialator::binDeserialize(const char* blob, int blobSize){
-  StreambufWrapper sb((char*)blob, blobSize); // create streambuf from blob without copying
-  istream is(&sb);                            // wrap streambuf in istream
-  binDeserialize(is);                         // deserialize from streambuf
+  BufferReader br(blob, blob+blobSize);    // read directly from blob, no istream
+  BinReadArchive ar(br);
+  ar & *this;
 }
 
 ////////////////////////////////////////////////
@@ -202,32 +1324,63 @@ static const char* vecptr(const vector<char>& vec){
 }
 
 void Serialator::textSerialize(vector<char>& blob){
-  stringstream ss;                      
-  textSerialize(ss);           // serialize to stream
-  int size = ss.tellp();       // get size of stream
-  blob.resize(size);           // resize blob
-  ss.read(vecptr(blob), size);  // copy stream to buffer
+  blob.clear();                            // keeps capacity for reuse
+  BufferWriter bw(blob);                   // format directly into growable blob
+  try{
+    Archive ar(Archive::WRITE_TEXT,bw);
+    ar & *this;
+  }catch(...){
+    blob.clear();
+    throw;
+  }
+  bw.finish();
 }
 
 void Serialator::textDeserialize(const vector<char>& blob){
   textDeserialize(vecptr(blob), blob.size());
 }
 
-void Serialator::binSerialize(vector<char>& blob){
-  Archive ar(Archive::SERIAL_SIZE_BIN);   // setup size calculating archive
-  ar & *this;                             // calculate size
-  blob.resize(ar.mSerializedSize);        // resize blob to calculated size
-  binSerialize(vecptr(blob), blob.size()); // serialize to blob
+void Serialator::binSerialize(vector<char>& blob, size_t capacityHint){
+  blob.clear();                            // keeps capacity for reuse
+  binSerializeAppend(blob, capacityHint);
 }
 
 void Serialator::binDeserialize(const vector<char>& blob){
-  binDeserialize(blob.data(), blob.size());
+  BufferReader br(vecptr(blob), vecptr(blob)+blob.size());
+  BinReadArchive ar(br);
+  ar & *this;
+}
+
+size_t Serialator::binSerializeAppend(vector<char>& blob, size_t capacityHint){
+  size_t start = blob.size();
+  try{
+    BufferWriter bw(blob, capacityHint);   // single pass into growable buffer
+    BinWriteArchive ar(bw);
+    ar & *this;
+    bw.finish();                           // trim to size written
+  }catch(...){
+    blob.resize(start);                    // drop partial output
+    throw;
+  }
+  return blob.size() - start;
+}
+
+size_t Serialator::binSerializedSize(){
+  BinSizeArchive ar;
+  ar & *this;
+  return ar.mSerializedSize;
 }
 
 //////////////////////////////////////////
 // Serialize/deserialize to/from file   //
 //////////////////////////////////////////
 
+void Serialator::binDeserialize(const MappedFile& file){
+  BufferReader br(file.data(), file.data()+file.size());
+  BinReadArchive ar(br);
+  ar & *this;
+}
+
 void Serialator::textSerializeFile(const std::string& filename){
   ofstream ofs(filename.c_str());
   if(ofs.fail()) throw runtime_error("textSerializeFile: cannot open file");
@@ -235,7 +1388,14 @@ void Serialator::textSerializeFile(const std::string& filename){
 }
 
 void Serialator::textDeserializeFile(const std::string& filename){
-  ifstream ifs(filename.c_str());
+  MappedFile mf(filename);
+  if(mf.isMapped()){                      // parse mapping in place
+    BufferReader br(mf.data(), mf.data()+mf.size());
+    Archive ar(Archive::READ_TEXT,br);
+    ar & *this;
+    return;
+  }
+  ifstream ifs(filename.c_str());         // fall back to streaming
   if(ifs.fail()) throw runtime_error("textSerializeFile: cannot open file");
   textDeserialize(ifs);
 }
@@ -247,10 +1407,335 @@ void Serialator::binSerializeFile(const std::string& filename){
 }
 
 void Serialator::binDeserializeFile(const std::string& filename){
-  ifstream ifs(filename.c_str(), ios::binary);
+  MappedFile mf(filename);
+  if(mf.isMapped()){                      // parse mapping in place, unmapped on return
+    BufferReader br(mf.data(), mf.data()+mf.size(), true);
+    BinReadArchive ar(br);
+    ar & *this;
+    return;
+  }
+  ifstream ifs(filename.c_str(), ios::binary); // fall back to streaming
   if(ifs.fail()) throw runtime_error("binDeserializeFile: cannot open file");
   binDeserialize(ifs);
 }
 
+//////////////////////////////////////////////////////
+// Binary serialize/deserialize with format options //
+//////////////////////////////////////////////////////
+
+static const size_t CHECKED_HEADER = 12;  // uint64 payload length, uint32 CRC32C
+
+// serialize ser through ar into bw, inside a BIN_CHECKED frame if requested.  The 
+// header is reserved first and filled in once the payload length and CRC are known.
+static void writeChecked(Archive& ar, BufferWriter& bw, Serialator& ser, Archive::BinFormat format){
+  if(!(format & Archive::BIN_CHECKED)){
+    ar & ser;
+    return;
+  }
+  char header[CHECKED_HEADER] = {};
+  size_t headerAt = bw.sizeUsed();
+  bw.write(header, CHECKED_HEADER, "WRITE_BIN: checked write error");
+  bw.beginCrc();
+  ar & ser;
+  uint64_t length = bw.sizeUsed() - headerAt - CHECKED_HEADER;
+  uint32_t crc = bw.crc();
+  memcpy(header, &length, 8);
+  memcpy(header+8, &crc, 4);
+  bw.patch(headerAt, header, CHECKED_HEADER);
+}
+
+// verify the BIN_CHECKED frame at the start of [data,data+size), returns its payload
+static BufferReader checkedPayload(const char* data, size_t size, bool transient=false){
+  if(size < CHECKED_HEADER) throw runtime_error("READ_BIN: checked frame truncated");
+  uint64_t length = load64(data);
+  if(length > size - CHECKED_HEADER) throw runtime_error("READ_BIN: checked frame truncated");
+  const char* payload = data + CHECKED_HEADER;
+  if(Crc32c::compute(payload, size_t(length)) != load32(data+8)) 
+    throw runtime_error("READ_BIN: checksum mismatch");
+  return BufferReader(payload, payload+length, transient);
+}
+
+// reader over a buffer holding binSerialize output with format, verified if BIN_CHECKED
+static BufferReader formatReader(const char* data, size_t size, Archive::BinFormat format, 
+                                 bool transient=false){
+  if(format & Archive::BIN_CHECKED) return checkedPayload(data, size, transient);
+  return BufferReader(data, data+size, transient);
+}
+
+void Serialator::binSerialize(std::ostream&os, Archive::BinFormat format){
+  if(format & Archive::BIN_CHECKED){      // header needs backpatching, frame in memory
+    vector<char> blob;
+    binSerialize(blob, format);
+    os.write(vecptr(blob), blob.size());
+    if(os.fail()) throw runtime_error("WRITE_BIN: checked write error");
+    return;
+  }
+  Archive ar(Archive::WRITE_BIN,os);
+  ar.mFormat = format;
+  ar & *this;
+}
+
+void Serialator::binDeserialize(std::istream&is, Archive::BinFormat format){
+  if(format & Archive::BIN_CHECKED){      // read whole frame, verify, then parse
+    char header[CHECKED_HEADER];
+    is.read(header, CHECKED_HEADER);
+    if(is.fail()) throw runtime_error("READ_BIN: checked frame truncated");
+    vector<char> frame(header, header+CHECKED_HEADER);
+    readChunked(is, frame, load64(header), "READ_BIN: checked frame truncated");
+    BufferReader br = checkedPayload(vecptr(frame), frame.size(), true);
+    Archive ar(Archive::READ_BIN,br);
+    ar.mFormat = format;
+    ar & *this;
+    return;
+  }
+  Archive ar(Archive::READ_BIN,is);
+  ar.mFormat = format;
+  ar & *this;
+}
+
+int Serialator::binSerialize(char* blob, int maxBlobSize, Archive::BinFormat format){
+  BufferWriter bw(blob, blob+maxBlobSize);
+  Archive ar(Archive::WRITE_BIN,bw);
+  ar.mFormat = format;
+  writeChecked(ar, bw, *this, format);
+  return bw.sizeUsed();
+}
+
+void Serialator::binDeserialize(const char* blob, int blobSize, Archive::BinFormat format){
+  BufferReader br = formatReader(blob, blobSize, format);
+  Archive ar(Archive::READ_BIN,br);
+  ar.mFormat = format;
+  ar & *this;
+}
+
+void Serialator::binSerialize(vector<char>& blob, Archive::BinFormat format, size_t capacityHint){
+  blob.clear();
+  BufferWriter bw(blob, capacityHint);
+  try{
+    Archive ar(Archive::WRITE_BIN,bw);
+    ar.mFormat = format;
+    writeChecked(ar, bw, *this, format);
+  }catch(...){
+    blob.clear();
+    throw;
+  }
+  bw.finish();
+}
+
+void Serialator::binDeserialize(const vector<char>& blob, Archive::BinFormat format){
+  BufferReader br = formatReader(vecptr(blob), blob.size(), format);
+  Archive ar(Archive::READ_BIN,br);
+  ar.mFormat = format;
+  ar & *this;
+}
+
+void Serialator::binSerializeFile(const std::string& filename, Archive::BinFormat format){
+  ofstream ofs(filename.c_str(), ios::binary);
+  if(ofs.fail()) throw runtime_error("binSerializeFile: cannot open file");
+  binSerialize(ofs, format);
+}
+
+void Serialator::binDeserializeFile(const std::string& filename, Archive::BinFormat format){
+  MappedFile mf(filename);
+  if(mf.isMapped()){                      // parse mapping in place, unmapped on return
+    BufferReader br = formatReader(mf.data(), mf.size(), format, true);
+    Archive ar(Archive::READ_BIN,br);
+    ar.mFormat = format;
+    ar & *this;
+    return;
+  }
+  ifstream ifs(filename.c_str(), ios::binary); // fall back to streaming
+  if(ifs.fail()) throw runtime_error("binDeserializeFile: cannot open file");
+  binDeserialize(ifs, format);
+}
+
+////////////////////////////////////////////
+// Delta serialization against a baseline //
+////////////////////////////////////////////
+
+// layout: int32 struct version, then the gap stream of the top level object
+size_t Serialator::binSerializeDelta(Serialator& base, vector<char>& delta){
+  delta.clear();
+  BufferWriter bw(delta);
+  try{
+    int32_t version = getStructVersion();
+    Archive header(Archive::WRITE_BIN, bw);
+    header & version;
+    vector<Archive::Walk::Field> stack;
+    Archive::Walk root(&stack);
+    Archive ar(Archive::WRITE_DELTA, bw);
+    ar.mpWalk = &root;
+    ar.deltaValue(*this, base);
+  }catch(...){
+    delta.clear();
+    throw;
+  }
+  bw.finish();
+  return delta.size();
+}
+
+void Serialator::binApplyDelta(const char* delta, int deltaSize){
+  BufferReader br(delta, delta+deltaSize);
+  int32_t version;
+  Archive header(Archive::READ_BIN, br);
+  header & version;
+  if(version!=getStructVersion()) throw runtime_error("READ_DELTA: struct version mismatch");
+  Archive ar(Archive::READ_DELTA, br);
+  ar.applyDelta(*this);
+}
+
+void Serialator::binApplyDelta(const vector<char>& delta){
+  binApplyDelta(vecptr(delta), int(delta.size()));
+}
+
+////////////////////////////////////////////
+// Hash of the binary serialization       //
+////////////////////////////////////////////
+
+// sink hashing each block as it fills up
+class HashingSink : public BufferSink{
+public:
+  void drain(const char* data, size_t n){ hash.update(data, n); }
+  Xxh64 hash;
+};
+
+static const size_t HASH_BLOCK = 8192;  // stays in L1 between encoding and hashing
+
+uint64_t Serialator::binHash(){
+  char block[HASH_BLOCK];
+  HashingSink sink;
+  BufferWriter bw(block, block+sizeof(block), sink);
+  BinWriteArchive ar(bw);
+  ar & *this;
+  bw.finish();
+  return sink.hash.digest();
+}
+
+uint64_t Serialator::binHash(Archive::BinFormat format){
+  if(format & Archive::BIN_CHECKED){      // header needs backpatching, hash in memory
+    vector<char> blob;
+    binSerialize(blob, format);
+    return Xxh64::compute(vecptr(blob), blob.size());
+  }
+  char block[HASH_BLOCK];
+  HashingSink sink;
+  BufferWriter bw(block, block+sizeof(block), sink);
+  Archive ar(Archive::WRITE_BIN, bw);
+  ar.mFormat = format;
+  ar & *this;
+  bw.finish();
+  return sink.hash.digest();
+}
+
+////////////////////////////////////////////
+// Deep copy through the archive method   //
+////////////////////////////////////////////
+
+void Serialator::cloneFrom(Serialator& source){
+  vector<Archive::Walk::Field> stack;
+  Archive::Walk root(&stack);
+  Archive ar(Archive::CLONE);
+  ar.mpWalk = &root;
+  ar.cloneValue(*this, source);
+}
+
+////////////////////////////////////////////
+// Comparison through the archive method  //
+////////////////////////////////////////////
+
+bool Serialator::equals(Serialator& other, string* path){
+  if(path) path->clear();
+  vector<Archive::Walk::Field> stack;
+  Archive::Walk root(&stack);
+  root.path = path;
+  Archive ar(Archive::COMPARE);
+  ar.mpWalk = &root;
+  return ar.compareValue(*this, other);
+}
+
+////////////////////////////////////////////////////
+// Binary serialize/deserialize with compression //
+////////////////////////////////////////////////////
+
+// serialize through fixed size blocks, each compressed as it fills up
+static void compressedSerialize(Serialator& ser, const Compression& comp, 
+                                vector<char>* vec, ostream* os){
+  size_t blockSize = min(max(comp.blockSize, size_t(4096)), BlockCodec::MAX_BLOCK);
+  vector<char> block(blockSize);
+  CompressingSink sink(comp.level, vec, os);
+  BufferWriter bw(&block[0], &block[0]+block.size(), sink);
+  BinWriteArchive ar(bw);
+  ar & ser;
+  bw.finish();
+  sink.close();
+}
+
+// deserialize from a decompressed buffer that is freed afterwards
+static void rawDeserialize(Serialator& ser, const vector<char>& raw){
+  BufferReader br(vecptr(raw), vecptr(raw)+raw.size(), true);
+  BinReadArchive ar(br);
+  ar & ser;
+}
+
+void Serialator::binSerialize(std::ostream&os, const Compression& comp){
+  compressedSerialize(*this, comp, NULL, &os);
+}
+
+void Serialator::binDeserialize(std::istream&is, const Compression&){
+  vector<char> raw, stored;
+  uint32_t magic = 0;
+  is.read((char*)&magic, 4);
+  if(is.fail() || magic!=BlockCodec::MAGIC) throw runtime_error("READ_BIN: not a compressed stream");
+  BlockCodec::Block block;
+  char header[8];
+  while(true){                             // decompress block by block as read
+    is.read(header, 8);
+    if(is.fail()) throw runtime_error("READ_BIN: compressed stream truncated");
+    if(!BlockCodec::blockHeader(header, block)) break;
+    stored.resize(block.storedSize);
+    is.read(&stored[0], block.storedSize);
+    if(is.fail()) throw runtime_error("READ_BIN: compressed stream truncated");
+    block.data = &stored[0];
+    block.rawOffset = raw.size();
+    raw.resize(raw.size() + block.rawSize);
+    BlockCodec::decompressBlock(block, &raw[0] + block.rawOffset);
+  }
+  rawDeserialize(*this, raw);
+}
+
+void Serialator::binSerialize(vector<char>& blob, const Compression& comp){
+  blob.clear();
+  try{
+    compressedSerialize(*this, comp, &blob, NULL);
+  }catch(...){
+    blob.clear();
+    throw;
+  }
+}
+
+void Serialator::binDeserialize(const vector<char>& blob, const Compression&){
+  vector<char> raw;
+  BlockCodec::decompress(vecptr(blob), blob.size(), raw);
+  rawDeserialize(*this, raw);
+}
+
+void Serialator::binSerializeFile(const std::string& filename, const Compression& comp){
+  ofstream ofs(filename.c_str(), ios::binary);
+  if(ofs.fail()) throw runtime_error("binSerializeFile: cannot open file");
+  binSerialize(ofs, comp);
+}
+
+void Serialator::binDeserializeFile(const std::string& filename, const Compression& comp){
+  MappedFile mf(filename);
+  if(mf.isMapped()){                      // decompress from mapping
+    vector<char> raw;
+    BlockCodec::decompress(mf.data(), mf.size(), raw);
+    rawDeserialize(*this, raw);
+    return;
+  }
+  ifstream ifs(filename.c_str(), ios::binary); // fall back to streaming
+  if(ifs.fail()) throw runtime_error("binDeserializeFile: cannot open file");
+  binDeserialize(ifs, comp);
+}
 
 }; //end namespace codepi
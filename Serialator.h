@@ -30,10 +30,21 @@
 #include <array>
 #include <map>
 #include <set>
+#include <unordered_map>
+#include <unordered_set>
 #include <list>
 #include <deque>
+#include <algorithm>
 #include <stdexcept>
 #include <type_traits>
+#include <memory>
+#include <new>
+#include <typeinfo>
+#include <cstring>
+#include <cstdio>
+#ifdef SERIALATOR_PROFILE
+#include <chrono>
+#endif
 
 #if defined(_MSC_VER) && _MSC_VER < 1600 // if Visual Studio before 2010
 typedef int int32_t;
@@ -42,9 +53,511 @@ typedef unsigned int uint32_t;
 #include <stdint.h>
 #endif
 
+// C++17 library features (string_view etc.) are used when available
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#define SERIALATOR_CXX17 1
+#include <string_view>
+#endif
+
 namespace codepi{
 
-class Serialator;  // Forward declaration
+class Serialator;  // Forward declarations
+class LazyBase;
+template <typename T> class Lazy;
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// Varint helpers for the compact binary format
+//   Integers are LEB128 encoded, 7 bits per byte with the high bit set on all but the
+//   last byte.  Signed integers are zigzag mapped first so small negatives stay short.
+struct Varint{
+  static const int MAX_BYTES = 10;
+
+  // map integer to unsigned wire value (zigzag if signed)
+  template <typename T>
+  static uint64_t toWire(T v){
+    if(std::is_signed<T>::value){
+      int64_t s = int64_t(v);
+      return (uint64_t(s) << 1) ^ uint64_t(s >> 63);
+    }
+    return uint64_t(v);
+  }
+
+  // map wire value back to integer, returns false if it does not fit in T
+  template <typename T>
+  static bool fromWire(uint64_t u, T& v){
+    if(std::is_signed<T>::value){
+      int64_t s = int64_t(u >> 1) ^ -int64_t(u & 1);
+      v = T(s);
+      return int64_t(v)==s;
+    }
+    v = T(u);
+    return uint64_t(v)==u;
+  }
+
+  // encode u into out (at least MAX_BYTES long), returns bytes used
+  static int encode(uint64_t u, char* out){
+    int n = 0;
+    while(u >= 0x80){
+      out[n++] = char(u | 0x80);
+      u >>= 7;
+    }
+    out[n++] = char(u);
+    return n;
+  }
+
+  // encoded size of u in bytes
+  static int size(uint64_t u){
+    int n = 1;
+    while(u >= 0x80){ u >>= 7; n++; }
+    return n;
+  }
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// CRC32C (Castagnoli) checksum, as used by BIN_CHECKED and RecordLog
+//   Uses the SSE4.2 crc32 instruction (detected at run time) or the ARMv8 CRC
+//   extension when compiled for it, and a slicing-by-8 table otherwise.
+struct Crc32c{
+  // checksum of n more bytes continuing from crc (0 to start)
+  static uint32_t extend(uint32_t crc, const void* data, size_t n);
+  static uint32_t compute(const void* data, size_t n){ return extend(0, data, n); }
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// XXH64 hash, as used by binHash
+//   Streaming 64-bit xxHash, equal to the reference XXH64 for the same bytes and seed.
+//   Each 32 byte stripe feeds four independent lanes, so the multiplies pipeline.
+class Xxh64{
+public:
+  explicit Xxh64(uint64_t seed=0);
+  void update(const void* data, size_t n);    // hash n more bytes
+  uint64_t digest() const;                     // digest of all bytes so far
+  static uint64_t compute(const void* data, size_t n, uint64_t seed=0){
+    Xxh64 hash(seed);
+    hash.update(data, n);
+    return hash.digest();
+  }
+
+private:
+  uint64_t mSeed;
+  uint64_t mLanes[4];
+  uint64_t mTotal;           // bytes hashed
+  char mTail[32];            // bytes not yet making up a whole stripe
+  size_t mTailSize;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// ByteOrder helpers for the fixed endian binary formats
+//   Scalars are swapped inline.  Arrays are swapped in bulk with SSSE3/AVX2 byte
+//   shuffles (picked at run time) or NEON, falling back to scalar code.
+struct ByteOrder{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_BIG_ENDIAN__
+  static const bool HOST_BIG = true;
+#else
+  static const bool HOST_BIG = false;
+#endif
+
+  static uint16_t swap(uint16_t v){ return uint16_t((v >> 8) | (v << 8)); }
+  static uint32_t swap(uint32_t v){
+    return (v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24);
+  }
+  static uint64_t swap(uint64_t v){
+    return (uint64_t(swap(uint32_t(v))) << 32) | swap(uint32_t(v >> 32));
+  }
+
+  // T with its bytes reversed
+  template <typename T>
+  static T swapValue(T v){
+    char b[sizeof(T)];
+    memcpy(b, &v, sizeof(T));
+    swapElements(b, b, 1, sizeof(T));
+    memcpy(&v, b, sizeof(T));
+    return v;
+  }
+
+  // copy n elements of size bytes each from src to dst reversing the bytes of each
+  // element (src may equal dst, otherwise they must not overlap)
+  static void swapArray(void* dst, const void* src, size_t n, size_t size);
+
+  // scalar version of swapArray
+  static void swapElements(char* dst, const char* src, size_t n, size_t size){
+    for(size_t i=0; i<n; i++, dst+=size, src+=size){
+      if(size==2){ uint16_t v; memcpy(&v, src, 2); v = swap(v); memcpy(dst, &v, 2); }
+      else if(size==4){ uint32_t v; memcpy(&v, src, 4); v = swap(v); memcpy(dst, &v, 4); }
+      else if(size==8){ uint64_t v; memcpy(&v, src, 8); v = swap(v); memcpy(dst, &v, 8); }
+      else for(size_t j=0; j<size/2; j++){ 
+        char c = src[j]; dst[j] = src[size-1-j]; dst[size-1-j] = c; 
+      }
+    }
+  }
+};
+
+// Wire type of T in the fixed endian formats: long and unsigned long (and so size_t
+// on LP64 systems) are always 64 bits, other types keep their size
+template <typename T>
+struct PinnedWidth{ typedef T type; };
+template <> struct PinnedWidth<long>{ typedef long long type; };
+template <> struct PinnedWidth<unsigned long>{ typedef unsigned long long type; };
+
+// Types whose width or layout differs between platforms (long double is 64, 80 or 128
+// bits, wchar_t is 2 or 4 bytes).  The fixed endian formats reject them.
+template <typename T>
+struct NonPortable{ 
+  static const bool value = std::is_same<T,long double>::value || std::is_same<T,wchar_t>::value;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// TextNumber helpers for text mode
+//   Numbers are formatted and parsed without iostreams or locales.  With C++17
+//   std::to_chars/std::from_chars are used and floating point values are written in
+//   the shortest form that reads back exactly.  Otherwise snprintf/strto* are used and
+//   floating point output matches the old operator<< output (6 significant digits).
+//   Integer output is the same as operator<< either way.
+struct TextNumber{
+  static const size_t MAX_CHARS = 64; // longest formatted value
+
+  // format v into buf (at least MAX_CHARS long), returns chars used
+  static size_t format(char* buf, long long v);
+  static size_t format(char* buf, unsigned long long v);
+  static size_t format(char* buf, float v);
+  static size_t format(char* buf, double v);
+  static size_t format(char* buf, long double v);
+
+  // parse all of [first,last) into v, returns false if malformed or out of range
+  static bool parse(const char* first, const char* last, long long& v);
+  static bool parse(const char* first, const char* last, unsigned long long& v);
+  static bool parse(const char* first, const char* last, float& v);
+  static bool parse(const char* first, const char* last, double& v);
+  static bool parse(const char* first, const char* last, long double& v);
+
+  // type T is formatted and parsed as (integers widen to 64 bits)
+  template <typename T>
+  struct Wide{
+    typedef typename std::conditional<std::is_floating_point<T>::value, T,
+      typename std::conditional<std::is_signed<T>::value, 
+        long long, unsigned long long>::type>::type type;
+  };
+
+  // char types are written as a single character, like operator<<
+  template <typename T>
+  struct IsChar{
+    static const bool value = std::is_same<T,char>::value || 
+      std::is_same<T,signed char>::value || std::is_same<T,unsigned char>::value;
+  };
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// BufferReader / BufferWriter
+//   Raw buffer backends used by Archive for the char* and vector<char> binary entry
+//   points.  They work directly on a pointer and an end pointer, so each field costs
+//   one bounds check and a memcpy instead of a trip through istream/ostream.
+class BufferReader{
+public:
+  // A transient buffer (e.g. decompressed input) is freed after deserialization, so
+  // zero-copy views into it are refused
+  BufferReader(const char* begin, const char* end, bool transient=false) 
+    : mpBegin(begin), mpCur(begin), mpEnd(end), mTransient(transient) {}
+
+  // copy n bytes to dst and advance, throws errMsg if buffer is too short
+  void read(void* dst, size_t n, const char* errMsg){
+    if(n > size_t(mpEnd-mpCur)) throw std::runtime_error(errMsg);
+    memcpy(dst, mpCur, n);
+    mpCur += n;
+  }
+
+  // decode one LEB128 varint and advance, throws errMsg if truncated or too long
+  uint64_t readVarint(const char* errMsg){
+    uint64_t u = 0;
+    for(int shift=0; shift<64; shift+=7){
+      if(mpCur==mpEnd) throw std::runtime_error(errMsg);
+      uint8_t b = uint8_t(*mpCur++);
+      u |= uint64_t(b & 0x7f) << shift;
+      if(!(b & 0x80)) return u;
+    }
+    throw std::runtime_error(errMsg);
+  }
+
+  // batch decode n varints into out (compact vector<int> fast path)
+  template <typename T>
+  void readVarints(T* out, size_t n, const char* errMsg){
+    for(size_t i=0; i<n; i++){
+      uint64_t u;
+      if(mpCur!=mpEnd && !(*mpCur & 0x80)) u = uint8_t(*mpCur++); // single byte fast path
+      else u = readVarint(errMsg);
+      if(!Varint::fromWire(u, out[i])) throw std::runtime_error(errMsg);
+    }
+  }
+
+  // return pointer to the next n bytes and advance past them (zero-copy read)
+  const char* take(size_t n, const char* errMsg){
+    if(mTransient) throw std::runtime_error("READ_BIN: views cannot point into a temporary buffer");
+    if(n > size_t(mpEnd-mpCur)) throw std::runtime_error(errMsg);
+    const char* p = mpCur;
+    mpCur += n;
+    return p;
+  }
+
+  // next byte without consuming it (EOF at end of buffer), and consume it (text mode)
+  int peek() const { return mpCur!=mpEnd ? uint8_t(*mpCur) : EOF; }
+  void skip() { if(mpCur!=mpEnd) mpCur++; }
+
+  // number of bytes consumed so far
+  size_t sizeUsed() const { return mpCur-mpBegin; }
+
+  // number of bytes left to read
+  size_t sizeLeft() const { return mpEnd-mpCur; }
+
+  // true if the buffer is freed after deserialization (see constructor)
+  bool transient() const { return mTransient; }
+
+  // limit reading to the next n bytes (e.g. a BIN_FRAMED object), returns the old end 
+  // for widen().  Throws errMsg if fewer than n bytes are left.
+  const char* narrow(size_t n, const char* errMsg){
+    if(n > size_t(mpEnd-mpCur)) throw std::runtime_error(errMsg);
+    const char* end = mpEnd;
+    mpEnd = mpCur + n;
+    return end;
+  }
+
+  // skip whatever is left of the narrowed range and restore the end saved by narrow()
+  void widen(const char* end){
+    mpCur = mpEnd;
+    mpEnd = end;
+  }
+
+private:
+  const char* mpBegin;
+  const char* mpCur;
+  const char* mpEnd;
+  bool mTransient;
+};
+
+// Destination a BufferWriter hands each full block to (e.g. the block compressor)
+class BufferSink{
+public:
+  virtual ~BufferSink() {}
+  virtual void drain(const char* data, size_t n) = 0;
+
+  // block of the same size to write into after drained was drained.  The default reuses
+  // it, a sink that keeps drained blocks in flight (e.g. AsyncFileWriter) hands out another.
+  virtual char* nextBlock(char* drained){ return drained; }
+};
+
+class BufferWriter{
+public:
+  // Fixed size writer, throws when the buffer is full
+  BufferWriter(char* begin, char* end) 
+    : mpVec(NULL), mStart(0), mpSink(NULL), mDrained(0), mpBegin(begin), mpCur(begin), mpEnd(end), 
+      mpLimit(end), mChecked(false), mCrc(0), mCrcStart(0), mCrcDone(0) {}
+
+  // Streaming writer using [begin,end) as a block buffer.  Whenever it fills up the
+  // block is drained to sink and the buffer reused; finish() drains the last block.
+  BufferWriter(char* begin, char* end, BufferSink& sink) 
+    : mpVec(NULL), mStart(0), mpSink(&sink), mDrained(0), mpBegin(begin), mpCur(begin), mpEnd(end), 
+      mpLimit(end), mChecked(false), mCrc(0), mCrcStart(0), mCrcDone(0) {}
+
+  // Growable writer appending to the end of vec.  The vector grows geometrically
+  // (starting from its existing capacity or capacityHint) and must be trimmed with
+  // finish() once writing is done.
+  explicit BufferWriter(std::vector<char>& vec, size_t capacityHint=0);
+
+  // copy n bytes from src and advance, grows, drains or throws errMsg if buffer is too short
+  void write(const void* src, size_t n, const char* errMsg){
+    if(n > size_t(mpLimit-mpCur)){
+      writeSlow(src, n, errMsg);
+      return;
+    }
+    memcpy(mpCur, src, n);
+    mpCur += n;
+  }
+
+  // number of bytes written so far (since the last drain for streaming writers)
+  size_t sizeUsed() const { return mpCur-mpBegin; }
+
+  // number of bytes written so far, including those already drained
+  uint64_t bytesWritten() const { return mDrained + sizeUsed(); }
+
+  // true for streaming writers, whose drained bytes can no longer be patched
+  bool streaming() const { return mpSink!=NULL; }
+
+  // trim growable vector to the bytes written, or drain the last block to the sink
+  // (no-op for fixed buffers)
+  void finish();
+
+  // Start a CRC32C of everything written from here on.  The checksum is folded in
+  // small chunks as the buffer fills, while the bytes are still in cache.
+  void beginCrc();
+  uint32_t crc();           // CRC32C of the bytes written since beginCrc()
+
+  // overwrite n bytes at offset (from where writing started) with src, e.g. to fill in
+  // a header once its contents are known.  Must be called before finish().  Bytes
+  // already folded into the CRC are corrected in it.
+  void patch(size_t offset, const void* src, size_t n);
+
+  // drop everything written after the first used bytes (e.g. a speculative write that
+  // turned out to be unneeded).  Not for streaming writers or after beginCrc().
+  void rewind(size_t used){ mpCur = mpBegin + used; }
+
+private:
+  // write that doesn't fit before mpLimit
+  void writeSlow(const void* src, size_t n, const char* errMsg);
+  // make room for n more bytes, throws errMsg if not growable
+  void grow(size_t n, const char* errMsg);
+  // add the bytes written since the last fold to mCrc
+  void foldCrc();
+  // place mpLimit at the end of the buffer or of the current CRC chunk
+  void updateLimit();
+
+  std::vector<char>* mpVec; // growable vector (null for fixed buffers)
+  size_t mStart;            // offset in mpVec where writing started
+  BufferSink* mpSink;       // block sink (null unless streaming)
+  uint64_t mDrained;        // bytes handed to mpSink so far
+  char* mpBegin;
+  char* mpCur;
+  char* mpEnd;
+  char* mpLimit;            // end of fast path writes (mpEnd unless checksumming)
+  bool mChecked;            // CRC32C being computed
+  uint32_t mCrc;
+  size_t mCrcStart;         // offset where beginCrc() was called
+  size_t mCrcDone;          // offset of first byte not yet in mCrc
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// BitwiseSerializable trait
+//   Opts a trivially copyable type into bulk memcpy transfer when it is the element type
+//   of a vector, std::array or deque (deques are copied chunk by chunk).  Binary output
+//   of such a container is the element count, a layout tag built from sizeof(T) and the
+//   registered version, then the raw element bytes.  Reading checks the layout tag and
+//   throws on mismatch.  Text mode still goes element by element, so an operator& for T
+//   is needed as usual.  Register at global scope with:
+//
+//     SERIALATOR_BITWISE(Point3f, 1)
+//
+//   std::array of a registered type is itself registered with the element's version.
+template <typename T>
+struct BitwiseSerializable{
+  static const bool value = false;
+  static const uint32_t version = 0;
+};
+
+template <typename T, size_t N>
+struct BitwiseSerializable<std::array<T,N> >{
+  static const bool value = BitwiseSerializable<T>::value;
+  static const uint32_t version = BitwiseSerializable<T>::version;
+};
+
+#define SERIALATOR_BITWISE(TYPE, VERSION)                 \
+  namespace codepi{                                       \
+  template <> struct BitwiseSerializable<TYPE>{           \
+    static const bool value = true;                       \
+    static const uint32_t version = VERSION;              \
+  }; }
+
+// True for element types copied as one contiguous block in binary mode
+template <typename T>
+struct IsBulk{
+  static const bool value = std::is_arithmetic<T>::value || BitwiseSerializable<T>::value;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// AllocElement
+//   Builds the empty temporary an element of a node container (map, set, list, deque) is
+//   deserialized into.  If the element type takes an allocator (uses-allocator
+//   construction) it gets the container's, so the elements of e.g. a std::pmr::map are
+//   allocated from the container's memory resource and then moved in without a copy.
+//   Map entries are built as pair<K,V> rather than pair<const K,V> so the key moves too.
+template <typename T, typename A, typename Enable=void>
+struct AllocElement{
+  typedef T type;
+  static T make(const A&){ return T(); }
+};
+
+template <typename T, typename A>
+struct AllocElement<T, A, typename std::enable_if<std::uses_allocator<T,A>::value &&
+    std::is_constructible<T, std::allocator_arg_t, const A&>::value>::type>{
+  typedef T type;
+  static T make(const A& alloc){ return T(std::allocator_arg, alloc); }
+};
+
+template <typename T, typename A>
+struct AllocElement<T, A, typename std::enable_if<std::uses_allocator<T,A>::value &&
+    !std::is_constructible<T, std::allocator_arg_t, const A&>::value>::type>{
+  typedef T type;
+  static T make(const A& alloc){ return T(alloc); }
+};
+
+template <typename T1, typename T2, typename A>
+struct AllocElement<std::pair<T1,T2>, A, void>{
+  typedef AllocElement<typename std::remove_const<T1>::type, A> First;
+  typedef AllocElement<T2, A> Second;
+  typedef std::pair<typename First::type, typename Second::type> type;
+  static type make(const A& alloc){ return type(First::make(alloc), Second::make(alloc)); }
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// ArrayView class
+//   Non-owning view of an arithmetic array, serialized exactly like std::vector<T>
+//   (ArrayView<char> is also wire compatible with std::string).
+//   When deserialized from a raw buffer (the char* and vector<char> binDeserialize
+//   methods) it points straight into that buffer instead of copying.  The view is then
+//   only valid while that buffer is alive and unmodified.  Deserializing a view from a
+//   stream, from text or from the compact format throws.
+//   Elements in the buffer may be unaligned: operator[] loads through memcpy, and
+//   aligned() returns NULL unless the data can be used directly as a T array.
+template <typename T>
+class ArrayView{
+  static_assert(std::is_arithmetic<T>::value, "ArrayView requires an arithmetic type");
+public:
+  ArrayView() : mpData(NULL), mSize(0) {}
+  ArrayView(const T* data, size_t size) : mpData((const char*)data), mSize(size) {}
+  ArrayView(const std::vector<T>& vec) : mpData((const char*)vec.data()), mSize(vec.size()) {}
+
+  size_t size() const { return mSize; }
+  bool empty() const { return mSize==0; }
+
+  // element i, safe for unaligned data
+  T operator[](size_t i) const {
+    T val;
+    memcpy(&val, mpData + i*sizeof(T), sizeof(T));
+    return val;
+  }
+
+  // raw bytes of the view
+  const char* bytes() const { return mpData; }
+
+  // data as a T array, or NULL if the underlying bytes are not aligned for T
+  const T* aligned() const {
+    return (size_t(mpData) % std::alignment_of<T>::value)==0 ? (const T*)mpData : NULL;
+  }
+
+  // view of size elements stored (possibly unaligned) at data
+  static ArrayView fromBytes(const char* data, size_t size){
+    ArrayView view;
+    view.mpData = data;
+    view.mSize = size;
+    return view;
+  }
+
+  // copy out into an owning vector
+  std::vector<T> toVector() const {
+    std::vector<T> vec(mSize);
+    if(mSize>0) memcpy(vec.data(), mpData, mSize*sizeof(T));
+    return vec;
+  }
+
+private:
+  const char* mpData;
+  size_t mSize;
+};
+
+// Opt-in per type profiling (see Profiler), compiled out unless SERIALATOR_PROFILE is
+// defined for every translation unit including Serialator.cpp
+#ifdef SERIALATOR_PROFILE
+template <typename Ar> class ProfileScope;
+#define SERIALATOR_PROFILE_SCOPE(var) ProfileScope<ProfileSelf> profileScope_(*this, typeid(var))
+#else
+#define SERIALATOR_PROFILE_SCOPE(var)
+#endif
 
 ///////////////////////////////////////////////////////////////////////////////////////////
 // Archive Class
@@ -58,41 +571,121 @@ public:
     WRITE_BIN,       // Write to binary stream
     READ_TEXT,       // Read from text stream
     WRITE_TEXT,      // Write to text stream
-    SERIAL_SIZE_BIN  // Calculate binary serialized size
+    SERIAL_SIZE_BIN, // Calculate binary serialized size
+    RECORD,          // Record field addresses of a baseline object for a lockstep walk
+    WRITE_DELTA,     // Write the changes from the recorded baseline to this object
+    READ_DELTA,      // Apply changes written by WRITE_DELTA to an object in place
+    CLONE,           // Copy the fields of a recorded source object into this object
+    COMPARE          // Compare this object's fields with those of a recorded object
+  };
+
+  // Binary format options, passed to the Serialator bin* overloads taking a BinFormat.
+  // Options may be combined with |.  Data must be read back with the same wire format
+  // options it was written with.
+  enum BinFormat{
+    BIN_DEFAULT = 0,  // fixed width host order integers (original format)
+    BIN_COMPACT = 1,  // LEB128 varint integers, sizes and versions (zigzag if signed)
+    BIN_REUSE   = 2,  // read only, not a wire format option: deserialize into the existing
+                      //   map/set nodes (C++17), list nodes and deque elements, keeping
+                      //   their string and vector capacity instead of rebuilding them
+    BIN_CHECKED = 4,  // frame the output as uint64 payload length, uint32 CRC32C of the
+                      //   payload, payload.  The checksum is verified before parsing.
+    BIN_LITTLE_ENDIAN = 8,  // portable fixed byte order for all fixed width values, with
+    BIN_BIG_ENDIAN   = 16,  //   long/unsigned long written as 64 bits.  Free on hosts of
+                            //   that byte order, bulk arrays are SIMD swapped on others.
+                            //   BitwiseSerializable structs go element by element.
+                            //   long double and wchar_t are not portable and throw.
+    BIN_FRAMED  = 32, // every Serialator (top level included) carries a uint32 byte length
+                      //   after its version.  Readers skip fields they don't know at the
+                      //   end of an object, and SkipNested members jump over whole objects.
+    BIN_SORTED  = 64  // write only, not a wire format option: write unordered_map and
+                      //   unordered_set elements ordered by the bytes of their keys instead
+                      //   of bucket order, so equal contents always give identical output
   };
 
   // Constructors
   Archive(ArchiveType type);                        // For INIT or SERIAL_SIZE_BIN
   Archive(ArchiveType type, std::istream& istream); // For READ_BIN or READ_TEXT
   Archive(ArchiveType type, std::ostream& ostream); // For WRITE_BIN or WRITE_TEXT
+  Archive(ArchiveType type, BufferReader& reader);  // For READ_BIN or READ_TEXT from raw buffer
+  Archive(ArchiveType type, BufferWriter& writer);  // For WRITE_BIN or WRITE_TEXT to raw buffer
   
   // operator& for serializing and deserializing strings
   Archive& operator& (std::string& var);
 
+  // operator& for strings with another allocator (e.g. std::pmr::string)
+  template <typename A>
+  Archive& operator& (std::basic_string<char,std::char_traits<char>,A>& var){
+    stringHelper(var);
+    return *this;
+  }
+
   // operator& for serializing and deserializing descendants of Serialator
   Archive& operator& (Serialator& ser);
 
-  // operator& for serializing and deserializing vectors
+  // operator& for nested objects decoded on first access (see Lazy)
+  Archive& operator& (LazyBase& lazy);
+  template <typename T>
+  Archive& operator& (Lazy<T>& lazy){ return *this & static_cast<LazyBase&>(lazy); }
+
+  // operator& for zero-copy views of arithmetic arrays (see ArrayView)
   template <typename T>
-  Archive& operator& (std::vector<T>& vec){
-    if(mType==INIT) vec.clear();
+  Archive& operator& (ArrayView<T>& view){
+    uint32_t size = view.size();
+    if(walking()) walkField(view);
+    else if(mType==INIT) view = ArrayView<T>();
+    else if(mType==READ_BIN){
+      (*this) & size;
+      bool converted = !bulk<T>() || (sizeof(T)>1 && swapBytes());
+      view = ArrayView<T>::fromBytes(
+        viewBytes(sizeof(T)*size, converted, "READ_BIN: \"view\" read error"), size);
+    }else if(mType==READ_TEXT){
+      throw std::runtime_error("READ_TEXT: views cannot be deserialized from text");
+    }else if(mType!=WRITE_TEXT && bulk<T>()){     // WRITE_BIN or SERIAL_SIZE_BIN
+      (*this) & size;
+      if(mType==SERIAL_SIZE_BIN) mSerializedSize += sizeof(T)*size;
+      else if(size>0) writeBulk((const T*)view.bytes(), size, "WRITE_BIN: \"view\" write error");
+    }else{                                           // text or compact, element by element
+      (*this) & size;
+      for(uint32_t i=0;i<size;i++){ T val = view[i]; (*this) & val; }
+    }
+    return *this;
+  }
+
+#ifdef SERIALATOR_CXX17
+  // operator& for zero-copy string views, wire compatible with std::string.
+  // Same lifetime rules as ArrayView.
+  Archive& operator& (std::string_view& var);
+#endif
+
+  // operator& for serializing and deserializing vectors
+  template <typename T, typename A>
+  Archive& operator& (std::vector<T,A>& vec){
+    SERIALATOR_PROFILE_SCOPE(vec);
+    if(walking()) walkField(vec);
+    else if(mType==INIT) vec.clear();
     else{
       uint32_t size = vec.size(); // get size (if writing)
       (*this) & size;             // read or write size
       vec.resize(size);           // resize (if reading)
 
+      // compact read of integer values
+      if(mType==READ_BIN && useVarint<T>() && mpReader){
+        readVarints(vec.data(), size, "READ_BIN: \"vector\" read error");
+
       // binary read of contiguous values
-      if(mType==READ_BIN && std::is_arithmetic<T>::value){
-        if(size>0) mpIStream->read((char*)vec.data(), sizeof(T)*size); // read all data
-        if(mpIStream->fail()) throw std::runtime_error("READ_BIN: \"vector\" read error");
+      }else if(mType==READ_BIN && bulk<T>()){
+        bulkLayout<T>();
+        if(size>0) readBulk(vec.data(), size, "READ_BIN: \"vector\" read error");
 
       // binary write of contiguous values
-      }else if(mType==WRITE_BIN && std::is_arithmetic<T>::value){
-        if(size>0) mpOStream->write((char*)vec.data(), sizeof(T)*size);
-        if(mpOStream->fail()) throw std::runtime_error("WRITE_BIN: \"vector\" write error");
+      }else if(mType==WRITE_BIN && bulk<T>()){
+        bulkLayout<T>();
+        if(size>0) writeBulk(vec.data(), size, "WRITE_BIN: \"vector\" write error");
 
       // get binary size of contiguous values
-      }else if(mType==SERIAL_SIZE_BIN && std::is_arithmetic<T>::value){
+      }else if(mType==SERIAL_SIZE_BIN && bulk<T>()){
+        bulkLayout<T>();
         mSerializedSize += sizeof(T)*size;
         
       // cases not covered by above (text and non-contiguous)
@@ -107,24 +700,31 @@ public:
   // operator& for serializing and deserializing std::array
   template <typename T, size_t N>
   Archive& operator& (std::array<T,N>& arr){
-    if(mType==INIT) arr.fill(T());
+    SERIALATOR_PROFILE_SCOPE(arr);
+    if(walking()) walkField(arr);
+    else if(mType==INIT) arr.fill(T());
     else{
       uint32_t size = arr.size(); // get size (if writing)
       (*this) & size;             // read or write size
       if(size > arr.size()) throw std::runtime_error("operator& array size error");
 
+      // compact read of integer values
+      if(mType==READ_BIN && useVarint<T>() && mpReader){
+        readVarints(arr.data(), size, "READ_BIN: \"array\" read error");
+
       // binary read of contiguous values
-      if(mType==READ_BIN && std::is_arithmetic<T>::value){
-        if(size>0) mpIStream->read((char*)arr.data(), sizeof(T)*size); // read all data
-        if(mpIStream->fail()) throw std::runtime_error("READ_BIN: \"array\" read error");
+      }else if(mType==READ_BIN && bulk<T>()){
+        bulkLayout<T>();
+        if(size>0) readBulk(arr.data(), size, "READ_BIN: \"array\" read error");
 
       // binary write of contiguous values
-      }else if(mType==WRITE_BIN && std::is_arithmetic<T>::value){
-        if(size>0) mpOStream->write((char*)arr.data(), sizeof(T)*size);
-        if(mpOStream->fail()) throw std::runtime_error("WRITE_BIN: \"array\" write error");
+      }else if(mType==WRITE_BIN && bulk<T>()){
+        bulkLayout<T>();
+        if(size>0) writeBulk(arr.data(), size, "WRITE_BIN: \"array\" write error");
 
       // get binary size of contiguous values
-      }else if(mType==SERIAL_SIZE_BIN && std::is_arithmetic<T>::value){
+      }else if(mType==SERIAL_SIZE_BIN && bulk<T>()){
+        bulkLayout<T>();
         mSerializedSize += sizeof(T)*size;
         
       // cases not covered by above (text and non-contiguous)
@@ -137,30 +737,66 @@ public:
   }
 
   // operator& for serializing and deserializing maps of any supported types
-  template <typename T1, typename T2>
-  Archive& operator& (std::map<T1,T2>& mp){
+  template <typename T1, typename T2, typename C, typename A>
+  Archive& operator& (std::map<T1,T2,C,A>& mp){
+    SERIALATOR_PROFILE_SCOPE(mp);
     containerHelper(mp);
     return *this;
   }
 
   // operator& for serializing and deserializing sets of any supported types
-  template <typename T>
-  Archive& operator& (std::set<T>& s){
+  template <typename T, typename C, typename A>
+  Archive& operator& (std::set<T,C,A>& s){
+    SERIALATOR_PROFILE_SCOPE(s);
+    containerHelper(s);
+    return *this;
+  }
+
+  // operator& for serializing and deserializing hash maps of any supported types.
+  // Same wire format as std::map, written in bucket order unless BIN_SORTED is set.
+  template <typename K, typename T, typename H, typename E, typename A>
+  Archive& operator& (std::unordered_map<K,T,H,E,A>& mp){
+    SERIALATOR_PROFILE_SCOPE(mp);
+    containerHelper(mp);
+    return *this;
+  }
+
+  // operator& for serializing and deserializing hash sets of any supported types
+  template <typename T, typename H, typename E, typename A>
+  Archive& operator& (std::unordered_set<T,H,E,A>& s){
+    SERIALATOR_PROFILE_SCOPE(s);
     containerHelper(s);
     return *this;
   }
 
   // operator& for serializing and deserializing lists of any supported types
-  template <typename T>
-  Archive& operator& (std::list<T>& l){
+  template <typename T, typename A>
+  Archive& operator& (std::list<T,A>& l){
+    SERIALATOR_PROFILE_SCOPE(l);
     containerHelper(l);
     return *this;
   }
 
   // operator& for serializing and deserializing deques of any supported types
-  template <typename T>
-  Archive& operator& (std::deque<T>& d){
-    containerHelper(d);
+  // Bulk element types are copied in binary mode one contiguous chunk at a time.
+  template <typename T, typename A>
+  Archive& operator& (std::deque<T,A>& d){
+    SERIALATOR_PROFILE_SCOPE(d);
+    if(walking()) walkField(d);
+    else if(bulk<T>() && (mType==READ_BIN || mType==WRITE_BIN || mType==SERIAL_SIZE_BIN)){
+      uint32_t size = d.size(); // get size (if writing)
+      (*this) & size;           // read or write size
+      d.resize(size);           // resize (if reading)
+      bulkLayout<T>();
+      for(uint32_t i=0; i<size; ){
+        uint32_t n = dequeChunk(d, i);
+        if(mType==READ_BIN) readBulk(&d[i], n, "READ_BIN: \"deque\" read error");
+        else if(mType==WRITE_BIN) writeBulk(&d[i], n, "WRITE_BIN: \"deque\" write error");
+        else mSerializedSize += sizeof(T)*n;
+        i += n;
+      }
+    }
+    else containerHelper(d);
     return *this;
   }
 
@@ -184,28 +820,37 @@ public:
         var = T();
         break;
       case READ_BIN: 
-        mpIStream->read((char*)&var, sizeof(var));
-        if(mpIStream->fail()) throw std::runtime_error("READ_BIN: \"other\" read error");
+        if(useVarint<T>()) readVarint(var, "READ_BIN: \"other\" read error");
+        else if(fixedEndian()) readFixed(var, "READ_BIN: \"other\" read error");
+        else readBin(&var, sizeof(var), "READ_BIN: \"other\" read error");
         break;
 
       case WRITE_BIN: 
-        mpOStream->write((char*)&var, sizeof(var));
-        if(mpOStream->fail()) throw std::runtime_error("WRITE_BIN: \"other\" write error");
+        if(useVarint<T>()) writeVarint(var, "WRITE_BIN: \"other\" write error");
+        else if(fixedEndian()) writeFixed(var, "WRITE_BIN: \"other\" write error");
+        else writeBin(&var, sizeof(var), "WRITE_BIN: \"other\" write error");
         break;
 
       case READ_TEXT:  
-        *mpIStream >> var;
-        mpIStream->ignore(); // skip past space
-        if(mpIStream->fail()) throw std::runtime_error("READ_TEXT: \"other\" read error");
+        readTextValue(var, "READ_TEXT: \"other\" read error");
         break;
 
       case WRITE_TEXT:  
-        *mpOStream << var << " ";
-        if(mpOStream->fail()) throw std::runtime_error("WRITE_TEXT: \"other\" write error");
+        writeTextValue(var, "WRITE_TEXT: \"other\" write error");
         break;
 
       case SERIAL_SIZE_BIN:
-        mSerializedSize += sizeof(var);
+        if(useVarint<T>()) mSerializedSize += Varint::size(Varint::toWire(var));
+        else if(fixedEndian()) mSerializedSize += sizeof(typename PinnedWidth<T>::type);
+        else mSerializedSize += sizeof(var);
+        break;
+
+      case RECORD:
+      case WRITE_DELTA:
+      case READ_DELTA:
+      case CLONE:
+      case COMPARE:
+        walkField(var);
         break;
 
       default: 
@@ -222,94 +867,1741 @@ private:
   std::istream* mpIStream;
   // Pointer to output stream for serialization (null otherwise)
   std::ostream* mpOStream;
+  // Pointer to raw input buffer for binary deserialization (null otherwise)
+  BufferReader* mpReader;
+  // Pointer to raw output buffer for binary serialization (null otherwise)
+  BufferWriter* mpWriter;
   // Archive type (see enumeration above)
   ArchiveType mType;  
   // Size of serialized data (used by SERIAL_SIZE_BIN)
-  int mSerializedSize;
+  size_t mSerializedSize;
+  // Binary format options (see BinFormat above)
+  BinFormat mFormat;
   // friend
   friend class Serialator;
+  friend class LazyBase;
+  template <ArchiveType TYPE> friend class StaticArchive;
+
+#ifdef SERIALATOR_PROFILE
+  typedef Archive ProfileSelf;
+  template <typename Ar> friend class ProfileScope;
+  ArchiveType profileDirection() const { return mType; }
+  /// bytes read, written or sized so far (streams aren't counted)
+  uint64_t profilePosition() const {
+    return mpWriter ? mpWriter->bytesWritten() : mpReader ? mpReader->sizeUsed() : 
+      (mpIStream || mpOStream) ? 0 : mSerializedSize;
+  }
+#endif
   
-  /// helper function for handling maps and sets
-  /// workaround: map and set value_type contain const this casts off the const
+  /// true if integer type T is varint encoded in the current binary format
   template <typename T>
-  static T& remove_const(const T& val){
-    return const_cast<T&>(val);
+  bool useVarint() const {
+    return (mFormat & BIN_COMPACT) && std::is_integral<T>::value && sizeof(T)>1;
   }
-  
-  template <typename Container>
-  void containerHelper(Container& container){
-    uint32_t size;
-
-    switch(mType){
-    case READ_BIN:
-    case READ_TEXT:
-      container.clear();
-      (*this) & size;
-      for(uint32_t i=0; i<size; i++){
-        typename Container::value_type val;
-        (*this) & val;
-        container.insert(container.end(), std::move(val));
-      }
-      break;
 
-    case WRITE_BIN:
-    case WRITE_TEXT:
-    case SERIAL_SIZE_BIN:
-      size = container.size();
-      (*this) & size;
-      for(typename Container::iterator i=container.begin(); i!=container.end(); i++){
-        // Need const castoff to prevent compiler error.
-        // Value won't actually change, but compiler doesn't realize it.        
-        (*this) & remove_const(*i);
-      }
-      break;
+  /// true if one of the fixed byte order formats is selected
+  bool fixedEndian() const { return (mFormat & (BIN_LITTLE_ENDIAN | BIN_BIG_ENDIAN))!=0; }
 
-    case INIT:
-      container.clear();
-      break;
+  /// true if nested objects carry a byte length (BIN_FRAMED)
+  bool framed() const { return (mFormat & BIN_FRAMED)!=0; }
 
-    default: 
-      throw std::runtime_error("containerHelper switch hit default.  Code error"); 
-      break;
+  /// write or read ser's fields inside a BIN_FRAMED length prefix
+  void writeFramed(Serialator& ser, int32_t version);
+  void readFramed(Serialator& ser, int32_t version);
 
-    }
+  /// true if the selected fixed byte order differs from the host's
+  bool swapBytes() const { 
+    return (mFormat & (ByteOrder::HOST_BIG ? BIN_LITTLE_ENDIAN : BIN_BIG_ENDIAN))!=0; 
+  }
 
+  /// true if a run of T is copied as one block in the current binary format.  The fixed
+  /// endian formats only allow arithmetic types whose width is not pinned differently.
+  template <typename T>
+  bool bulk() const {
+    return IsBulk<T>::value && !useVarint<T>() && (!fixedEndian() || 
+      (std::is_arithmetic<T>::value && !NonPortable<T>::value && 
+       sizeof(typename PinnedWidth<T>::type)==sizeof(T)));
   }
 
-};
+  /// read a value in the fixed endian format (pinned width, swapped if needed)
+  template <typename T>
+  void readFixed(T& var, const char* errMsg){
+    if(NonPortable<T>::value) 
+      throw std::runtime_error("READ_BIN: long double and wchar_t have no portable byte order");
+    typedef typename PinnedWidth<T>::type Wire;
+    Wire wire;
+    readBin(&wire, sizeof(wire), errMsg);
+    if(swapBytes()) wire = ByteOrder::swapValue(wire);
+    var = T(wire);
+    if(Wire(var)!=wire && !std::is_floating_point<T>::value) 
+      throw std::runtime_error(errMsg);  // 64 bit long out of range for a 32 bit one
+  }
 
-///////////////////////////////////////////////////////////////////////////////////////////
-// Serialator class
-//   Descendants of this class should implement archive method which is called by all 
-//   of the public methods
-class Serialator{
-public:
-  void initAll();                         // init all elements to type default
-  
-  // Serialize/deserialize to/from stream
-  void textSerialize  (std::ostream&os);  // serialize to text stream 
-  void textDeserialize(std::istream&is);  // deserialize from text stream
-  void binSerialize   (std::ostream&os);  // serialize to binary stream
-  void binDeserialize (std::istream&is);  // deserialize from binary stream
+  /// write a value in the fixed endian format
+  template <typename T>
+  void writeFixed(T var, const char* errMsg){
+    if(NonPortable<T>::value) 
+      throw std::runtime_error("WRITE_BIN: long double and wchar_t have no portable byte order");
+    typename PinnedWidth<T>::type wire = var;
+    if(swapBytes()) wire = ByteOrder::swapValue(wire);
+    writeBin(&wire, sizeof(wire), errMsg);
+  }
 
-  // Serialize/deserialize to/from char* (serialize returns size used)
-  int  textSerialize  (      char* blob, int maxBlobSize);   
-  void textDeserialize(const char* blob, int blobSize); 
-  int  binSerialize   (      char* blob, int maxBlobSize);    
-  void binDeserialize (const char* blob, int blobSize);  
+  /// read n contiguous values, reversing their bytes in place if needed
+  template <typename T>
+  void readBulk(T* data, size_t n, const char* errMsg){
+    readBin(data, sizeof(T)*n, errMsg);
+    if(sizeof(T)>1 && swapBytes()) ByteOrder::swapArray(data, data, n, sizeof(T));
+  }
 
-  // Serialize/deserialize to/from vector<char>
-  void textSerialize  (      std::vector<char>& blob);   
-  void textDeserialize(const std::vector<char>& blob); 
-  void binSerialize   (      std::vector<char>& blob);    
-  void binDeserialize (const std::vector<char>& blob);  
+  /// write n contiguous values, through a small swap buffer if needed
+  template <typename T>
+  void writeBulk(const T* data, size_t n, const char* errMsg){
+    if(sizeof(T)==1 || !swapBytes()){
+      writeBin(data, sizeof(T)*n, errMsg);
+      return;
+    }
+    const size_t CHUNK = 4096/sizeof(T);
+    char buf[CHUNK*sizeof(T)];
+    for(size_t i=0; i<n; i+=CHUNK){
+      size_t m = std::min(CHUNK, n-i);
+      ByteOrder::swapArray(buf, (const char*)data + i*sizeof(T), m, sizeof(T));
+      writeBin(buf, m*sizeof(T), errMsg);
+    }
+  }
 
-  // Serialize/deserialize to/from file
-  void textSerializeFile  (const std::string& filename);   
-  void textDeserializeFile(const std::string& filename); 
+  /// read one varint encoded integer from raw buffer or istream
+  template <typename T>
+  void readVarint(T& var, const char* errMsg){
+    uint64_t u = 0;
+    if(mpReader) u = mpReader->readVarint(errMsg);
+    else{
+      for(int shift=0;; shift+=7){
+        int b = mpIStream->get();
+        if(b==EOF || shift>=64) throw std::runtime_error(errMsg);
+        u |= uint64_t(b & 0x7f) << shift;
+        if(!(b & 0x80)) break;
+      }
+    }
+    if(!Varint::fromWire(u, var)) throw std::runtime_error(errMsg);
+  }
+
+  /// pointer to the next n bytes of the raw input buffer for zero-copy views
+  /// (converted is true if the values need decoding or byte swapping)
+  const char* viewBytes(size_t n, bool converted, const char* errMsg){
+    if(!mpReader || converted) 
+      throw std::runtime_error("READ_BIN: views require host order raw buffer deserialization");
+    return mpReader->take(n, errMsg);
+  }
+
+  /// batch decode n varint encoded integers from raw buffer
+  template <typename T>
+  typename std::enable_if<std::is_integral<T>::value>::type
+    readVarints(T* data, size_t n, const char* errMsg){
+      mpReader->readVarints(data, n, errMsg);
+  }
+  template <typename T>
+  typename std::enable_if<!std::is_integral<T>::value>::type
+    readVarints(T*, size_t, const char*){} // never called, useVarint<T>() is false
+
+  /// write one varint encoded integer
+  template <typename T>
+  void writeVarint(T var, const char* errMsg){
+    char buf[Varint::MAX_BYTES];
+    writeBin(buf, Varint::encode(Varint::toWire(var), buf), errMsg);
+  }
+  
+  /// write a text mode value followed by a space
+  template <typename T>
+  void writeTextValue(T var, const char* errMsg){
+    char buf[TextNumber::MAX_CHARS+1];
+    size_t n = 1;
+    if(TextNumber::IsChar<T>::value) buf[0] = char(var);
+    else if(std::is_same<T,bool>::value) buf[0] = var ? '1' : '0';
+    else n = TextNumber::format(buf, typename TextNumber::Wide<T>::type(var));
+    buf[n++] = ' ';
+    writeBin(buf, n, errMsg);
+  }
+
+  /// read a text mode value and the space after it
+  template <typename T>
+  void readTextValue(T& var, const char* errMsg){
+    char buf[TextNumber::MAX_CHARS];
+    size_t n = readTextToken(buf, TextNumber::IsChar<T>::value ? 1 : sizeof(buf), errMsg);
+    if(TextNumber::IsChar<T>::value){
+      var = T(buf[0]);
+      return;
+    }
+    typename TextNumber::Wide<T>::type wide;
+    if(!TextNumber::parse(buf, buf+n, wide)) throw std::runtime_error(errMsg);
+    var = T(wide);
+    if(!std::is_floating_point<T>::value && typename TextNumber::Wide<T>::type(var)!=wide) 
+      throw std::runtime_error(errMsg);  // integer out of range for T
+  }
+
+  /// skip whitespace, then copy up to maxLen non-whitespace characters into buf and
+  /// skip the separator after them.  Returns the token length.
+  size_t readTextToken(char* buf, size_t maxLen, const char* errMsg){
+    int c;
+    while(isTextSpace(c = peekText())) skipText();
+    size_t n = 0;
+    while(n<maxLen && c!=EOF && !isTextSpace(c)){
+      buf[n++] = char(c);
+      skipText();
+      c = peekText();
+    }
+    if(n==0 || (n==maxLen && maxLen>1 && c!=EOF && !isTextSpace(c))) 
+      throw std::runtime_error(errMsg);  // missing or overlong token
+    skipText();                          // skip past space
+    return n;
+  }
+
+  static bool isTextSpace(int c){
+    return c==' ' || c=='\n' || c=='\t' || c=='\r' || c=='\v' || c=='\f';
+  }
+
+  /// next text input character from raw buffer or istream without consuming it
+  int peekText(){ return mpReader ? mpReader->peek() : mpIStream->rdbuf()->sgetc(); }
+
+  /// consume one text input character (no-op at end of input)
+  void skipText(){
+    if(mpReader) mpReader->skip();
+    else if(mpIStream->rdbuf()->sbumpc()==EOF) mpIStream->setstate(std::ios::eofbit);
+  }
+
+  /// binary read from raw buffer if present, otherwise from istream
+  void readBin(void* dst, size_t n, const char* errMsg){
+    if(mpReader) mpReader->read(dst, n, errMsg);
+    else{
+      mpIStream->read((char*)dst, n);
+      if(mpIStream->fail()) throw std::runtime_error(errMsg);
+    }
+  }
+
+  /// binary write to raw buffer if present, otherwise to ostream
+  void writeBin(const void* src, size_t n, const char* errMsg){
+    if(mpWriter) mpWriter->write(src, n, errMsg);
+    else{
+      mpOStream->write((const char*)src, n);
+      if(mpOStream->fail()) throw std::runtime_error(errMsg);
+    }
+  }
+
+  /// layout tag written ahead of BitwiseSerializable blocks
+  template <typename T>
+  static uint32_t layoutTag(){
+    static_assert(!BitwiseSerializable<T>::value || std::is_trivially_copyable<T>::value,
+      "BitwiseSerializable types must be trivially copyable");
+    static_assert(!BitwiseSerializable<T>::value || sizeof(T) < 0x10000, 
+      "BitwiseSerializable type too large");
+    return uint32_t(sizeof(T)) | (BitwiseSerializable<T>::version << 16);
+  }
+
+  /// read/write/size the layout tag of a bulk block (no-op for arithmetic types)
+  template <typename T>
+  void bulkLayout(){
+    if(!BitwiseSerializable<T>::value) return;
+    uint32_t tag = layoutTag<T>();
+    (*this) & tag;
+    if(tag!=layoutTag<T>()) throw std::runtime_error("READ_BIN: bitwise layout/version mismatch");
+  }
+
+  /// number of elements stored contiguously in a deque starting at index i
+  template <typename T, typename A>
+  static uint32_t dequeChunk(std::deque<T,A>& d, uint32_t i){
+    const T* first = &d[i];
+    uint32_t n = 1;
+    while(i+n < d.size() && &d[i+n] == first+n) n++;
+    return n;
+  }
+
+  /// helper function for handling strings of any allocator
+  template <typename String>
+  void stringHelper(String& var){
+    SERIALATOR_PROFILE_SCOPE(var);
+    uint32_t size;
+
+    switch(mType){
+    case INIT:
+      var.clear();
+      break;
+
+    case READ_BIN: 
+      (*this) & size;   // read string size from stream
+      var.resize(size); // resize string
+      if(size>0) readBin(&var[0], size, "READ_BIN: string read error"); // read string
+      break; 
+
+    case WRITE_BIN: 
+      size = var.size();
+      (*this) & size;   // write string size to stream
+      if(size>0) writeBin(var.c_str(), size, "WRITE_BIN: string write error"); // write string
+      break; 
+
+    case READ_TEXT:
+      (*this) & size;   // read string size from stream
+      var.resize(size); // resize string
+      if(size>0) readBin(&var[0], size, "READ_TEXT: string read error");  // read string
+      skipText();       // skip past space
+      break;
+
+    case WRITE_TEXT:
+      size = var.size();
+      (*this) & size;   // write string size to stream
+      if(size>0) writeBin(var.data(), size, "WRITE_TEXT: string write error"); // output string
+      writeBin(" ", 1, "WRITE_TEXT: string write error");                      // and space
+      break;
+
+    case SERIAL_SIZE_BIN:
+      size = var.size();
+      (*this) & size;   // size of string size
+      mSerializedSize += size;
+      break;
+
+    case RECORD:
+    case WRITE_DELTA:
+    case READ_DELTA:
+    case CLONE:
+    case COMPARE:
+      walkField(var);
+      break;
+
+    default: 
+      throw std::runtime_error("string operator& switch hit default.  Code error"); 
+      break;
+
+    };
+  }
+
+  /// helper function for handling maps and sets
+  /// workaround: map and set value_type contain const this casts off the const
+  template <typename T>
+  static T& remove_const(const T& val){
+    return const_cast<T&>(val);
+  }
+  
+  /// reuse mode read of a list or deque: resize, then read each element in place
+  template <typename T, typename A>
+  void reuseHelper(std::list<T,A>& l){
+    uint32_t size;
+    (*this) & size;
+    l.resize(size);
+    for(typename std::list<T,A>::iterator i=l.begin(); i!=l.end(); i++) (*this) & *i;
+  }
+
+  template <typename T, typename A>
+  void reuseHelper(std::deque<T,A>& d){
+    uint32_t size;
+    (*this) & size;
+    d.resize(size);
+    for(uint32_t i=0; i<size; i++) (*this) & d[i];
+  }
+
+  /// reuse mode read of a map or set: existing nodes are extracted and read into
+  /// before being reinserted, extra nodes are freed and missing ones allocated
+  template <typename T1, typename T2, typename C, typename A>
+  void reuseHelper(std::map<T1,T2,C,A>& mp){ reuseNodes(mp); }
+
+  template <typename T, typename C, typename A>
+  void reuseHelper(std::set<T,C,A>& s){ reuseNodes(s); }
+
+  template <typename K, typename T, typename H, typename E, typename A>
+  void reuseHelper(std::unordered_map<K,T,H,E,A>& mp){ reuseNodes(mp); }
+
+  template <typename T, typename H, typename E, typename A>
+  void reuseHelper(std::unordered_set<T,H,E,A>& s){ reuseNodes(s); }
+
+  template <typename Container>
+  void reuseNodes(Container& container){
+    uint32_t size;
+    (*this) & size;
+#ifdef SERIALATOR_CXX17
+    Container spare(container.get_allocator());
+    spare.swap(container);
+#else
+    container.clear();                        // no node extraction before C++17
+#endif
+    reserveFor(container, size, mpReader);
+    for(uint32_t i=0; i<size; i++){
+#ifdef SERIALATOR_CXX17
+      if(!spare.empty()){
+        typename Container::node_type node = spare.extract(spare.begin());
+        readNode(node);
+        container.insert(container.end(), std::move(node));
+        continue;
+      }
+#endif
+      typedef AllocElement<typename Container::value_type, 
+                           typename Container::allocator_type> Element;
+      typename Element::type val = Element::make(container.get_allocator());
+      (*this) & val;
+      container.insert(container.end(), std::move(val));
+    }
+  }
+
+#ifdef SERIALATOR_CXX17
+  /// read the contents of an extracted map or set node
+  template <typename Node>
+  auto readNode(Node& node) -> decltype(node.mapped(), void()){
+    (*this) & node.key() & node.mapped();
+  }
+  template <typename Node>
+  auto readNode(Node& node) -> decltype(node.value(), void()){
+    (*this) & node.value();
+  }
+#endif
+
+  /// pre-size a container about to receive size elements if it has reserve(), so hash
+  /// containers never rehash while reading.  Every element takes at least one byte, so
+  /// a corrupt size can't reserve more than what is left of a buffer being read.
+  template <typename Container>
+  static void reserveFor(Container& container, uint32_t size, const BufferReader* reader){
+    size_t n = reader ? std::min(size_t(size), reader->sizeLeft()) : size_t(size);
+    reserveIf(container, n, 0);
+  }
+  template <typename Container>
+  static auto reserveIf(Container& container, size_t n, int) -> decltype(container.reserve(n), void()){
+    container.reserve(n);
+  }
+  template <typename Container>
+  static void reserveIf(Container&, size_t, long){}
+
+  /// write the elements of a container in iteration order
+  template <typename Container>
+  void writeElements(Container& container){
+    for(typename Container::iterator i=container.begin(); i!=container.end(); i++){
+      // Need const castoff to prevent compiler error.
+      // Value won't actually change, but compiler doesn't realize it.        
+      (*this) & remove_const(*i);
+    }
+  }
+
+  template <typename K, typename T, typename H, typename E, typename A>
+  void writeElements(std::unordered_map<K,T,H,E,A>& mp){ writeHashed(mp); }
+
+  template <typename T, typename H, typename E, typename A>
+  void writeElements(std::unordered_set<T,H,E,A>& s){ writeHashed(s); }
+
+  /// element of a hash container and the range of its key in a buffer of encoded keys
+  template <typename Iter>
+  struct SortedElement{
+    size_t begin, end;
+    Iter element;
+  };
+
+  /// orders SortedElements by their key bytes
+  struct KeyBytesLess{
+    const char* keys;
+    template <typename Entry>
+    bool operator()(const Entry& a, const Entry& b) const {
+      int c = memcmp(keys+a.begin, keys+b.begin, std::min(a.end-a.begin, b.end-b.begin));
+      return c!=0 ? c<0 : a.end-a.begin < b.end-b.begin;
+    }
+  };
+
+  /// write a hash container in bucket order, or with BIN_SORTED in the order of its
+  /// keys' default binary encoding (any hashable key has one, unlike operator<)
+  template <typename Hashed>
+  void writeHashed(Hashed& container){
+    if(!(mFormat & BIN_SORTED) || mType==SERIAL_SIZE_BIN || container.size()<2){
+      for(typename Hashed::iterator i=container.begin(); i!=container.end(); i++)
+        (*this) & remove_const(*i);
+      return;
+    }
+    typedef SortedElement<typename Hashed::iterator> Entry;
+    std::vector<char> keys;
+    std::vector<Entry> order;
+    order.reserve(container.size());
+    BufferWriter writer(keys);
+    Archive ar(WRITE_BIN, writer);
+    ar.mFormat = BIN_SORTED;                  // hash containers inside keys too
+    for(typename Hashed::iterator i=container.begin(); i!=container.end(); i++){
+      Entry entry = { writer.sizeUsed(), 0, i };
+      ar & keyOf(*i);
+      entry.end = writer.sizeUsed();
+      order.push_back(entry);
+    }
+    writer.finish();
+    KeyBytesLess less = { keys.data() };
+    std::stable_sort(order.begin(), order.end(), less);
+    for(size_t i=0; i<order.size(); i++) (*this) & remove_const(*order[i].element);
+  }
+
+  template <typename Container>
+  void containerHelper(Container& container){
+    uint32_t size;
+
+    switch(mType){
+    case READ_BIN:
+    case READ_TEXT:
+      if(mFormat & BIN_REUSE){
+        reuseHelper(container);
+        break;
+      }
+      container.clear();
+      (*this) & size;
+      reserveFor(container, size, mpReader);
+      for(uint32_t i=0; i<size; i++){
+        typedef AllocElement<typename Container::value_type, 
+                             typename Container::allocator_type> Element;
+        typename Element::type val = Element::make(container.get_allocator());
+        (*this) & val;
+        container.insert(container.end(), std::move(val));
+      }
+      break;
+
+    case WRITE_BIN:
+    case WRITE_TEXT:
+    case SERIAL_SIZE_BIN:
+      size = container.size();
+      (*this) & size;
+      writeElements(container);
+      break;
+
+    case INIT:
+      container.clear();
+      break;
+
+    case RECORD:
+    case WRITE_DELTA:
+    case READ_DELTA:
+    case CLONE:
+    case COMPARE:
+      walkField(container);
+      break;
+
+    default: 
+      throw std::runtime_error("containerHelper switch hit default.  Code error"); 
+      break;
+
+    }
+
+  }
+
+
+  ///////////////////////////////////////////////////////////////////////////////////////
+  // Lockstep walks
+  //   A walk pairs each field of an object with the same field of a baseline object of
+  //   the same class.  The baseline's archive method is first run with a RECORD archive
+  //   that just collects field addresses, then the object's archive method runs with
+  //   the walk archive, which takes the matching baseline field for every field it is
+  //   handed.  Nested Serialators start a walk of their own.
+  //
+  //   Delta format: per object, a gap stream of varints, each gap+1 (gap = unchanged
+  //   fields skipped) followed by the change to that field, and 0 at the end.  A change
+  //   is the new value for numbers, strings and other values, a nested gap stream for
+  //   Serialators, and for containers:
+  //     vector/array of bulk type : new size, baseline size, (gap+1, run length, raw 
+  //                                 values)..., 0, then the added values
+  //     other sequences           : new size, baseline size, gap stream of element 
+  //                                 changes, then the added elements in full
+  //     map/set                   : (op, key[, value])..., 0 with op DELTA_ERASE, 
+  //                                 DELTA_UPDATE (value change) or DELTA_INSERT
+  //
+  //   Clone: the source is recorded as the baseline and each of its fields is copied
+  //   straight into the object's field, bulk containers with one memcpy.
+  //
+  //   Compare: each field is compared with the recorded one until the first difference,
+  //   bulk containers with one memcmp.  The path to that field is built on the way out.
+
+  /// per object state of a walk
+  struct Walk{
+    struct Field{ 
+      void* addr;                 // the field, or NULL if recorded by value
+      const std::type_info* type;
+      union{ long double ld; uint64_t u; } value;  // copy of an arithmetic field
+    };
+    // Baseline fields in archive order are pushed on a stack shared by nested walks,
+    // this walk's are from first on.  Nested walks pop theirs when done.
+    std::vector<Field>* fields;
+    size_t first;
+    size_t next;                // next baseline field to pair with
+    uint64_t gap;               // WRITE_DELTA: unchanged fields since the last change
+                                // READ_DELTA: fields to skip before the next change
+    bool changed;               // WRITE_DELTA: some field changed
+                                // COMPARE: a field differs, the rest are skipped
+    bool done;                  // READ_DELTA: no more changes in this object
+    std::string* path;          // COMPARE: path to the first difference, if wanted
+    explicit Walk(std::vector<Field>* stack=NULL) 
+      : fields(stack), first(stack ? stack->size() : 0), next(first), gap(0), 
+        changed(false), done(false), path(NULL) {}
+  };
+
+  // map/set delta operations
+  enum{ DELTA_END = 0, DELTA_ERASE = 1, DELTA_UPDATE = 2, DELTA_INSERT = 3 };
+
+  /// Walk of the current object (null unless walking)
+  Walk* mpWalk;
+
+  /// true for the lockstep walk archive types
+  bool walking() const { 
+    return mType==RECORD || mType==WRITE_DELTA || mType==READ_DELTA || mType==CLONE || 
+      mType==COMPARE; 
+  }
+
+  /// handle one field of a walk
+  template <typename T>
+  void walkField(T& var){
+    if(mType==RECORD){
+      Walk::Field field = { (void*)&var, &typeid(var) };
+      recordValue(field, var);
+      mpWalk->fields->push_back(field);
+    }else if(mType==WRITE_DELTA){
+      if(deltaEntry(var, baseField(var), mpWalk->gap)) mpWalk->changed = true;
+    }else if(mType==CLONE){
+      cloneValue(var, baseField(var));
+    }else if(mType==COMPARE){
+      compareField(var);
+    }else if(!mpWalk->done){                   // READ_DELTA
+      if(mpWalk->gap>0) mpWalk->gap--;
+      else{
+        applyDelta(var);
+        readGap(*mpWalk);
+      }
+    }
+  }
+
+  /// baseline field paired with var, throws if the objects don't line up
+  template <typename T>
+  T& baseField(T& var){
+    std::vector<Walk::Field>& fields = *mpWalk->fields;
+    if(mpWalk->next >= fields.size() || *fields[mpWalk->next].type!=typeid(var))
+      throw std::runtime_error(mType==CLONE ? "CLONE: source does not match object layout" :
+                               "WRITE_DELTA: baseline does not match object layout");
+    return fieldValue<T>(fields[mpWalk->next++]);
+  }
+
+  /// Numbers are recorded by value: archive() may pass a local or a converted copy,
+  /// which is gone by the time the fields are paired.  Strings, containers and nested
+  /// objects are recorded by address, so those must be members.
+  template <typename T>
+  static typename std::enable_if<std::is_arithmetic<T>::value>::type 
+    recordValue(Walk::Field& field, T& var){
+      field.addr = NULL;
+      new (&field.value) T(var);
+  }
+  template <typename T>
+  static typename std::enable_if<!std::is_arithmetic<T>::value>::type 
+    recordValue(Walk::Field&, T&){}
+
+  /// recorded field as a T
+  template <typename T>
+  static T& fieldValue(Walk::Field& field){
+    return field.addr ? *(T*)field.addr : *(T*)&field.value;
+  }
+
+  void writeDeltaVarint(uint64_t u){
+    char buf[Varint::MAX_BYTES];
+    mpWriter->write(buf, Varint::encode(u, buf), "WRITE_DELTA: write error");
+  }
+  uint64_t readDeltaVarint(){ return mpReader->readVarint("READ_DELTA: read error"); }
+
+  /// read the next gap of a gap stream
+  void readGap(Walk& walk){
+    uint64_t g = readDeltaVarint();
+    if(g==0) walk.done = true;
+    else walk.gap = g-1;
+  }
+
+  /// one entry of a gap stream: gap+1 and the change from base to var, or nothing
+  /// (and one more in gap) if they are equal.  Returns true if changed.
+  template <typename T>
+  bool deltaEntry(T& var, T& base, uint64_t& gap){
+    size_t mark = mpWriter->sizeUsed();
+    writeDeltaVarint(gap+1);
+    if(deltaValue(var, base)){
+      gap = 0;
+      return true;
+    }
+    mpWriter->rewind(mark);
+    gap++;
+    return false;
+  }
+
+  /// whole value in the default binary format
+  template <typename T>
+  void writeFull(T& var){
+    Archive ar(WRITE_BIN, *mpWriter);
+    ar & var;
+  }
+  template <typename T>
+  void readFull(T& var){
+    Archive ar(READ_BIN, *mpReader);
+    ar & var;
+  }
+
+  /// write the change from base to var, returns false (caller rewinds) if equal
+  template <typename T>
+  typename std::enable_if<std::is_arithmetic<T>::value, bool>::type
+    deltaValue(T& var, T& base){
+      bool same = std::is_floating_point<T>::value && sizeof(T)<=8 ?  // bitwise, so NaN
+        memcmp(&var, &base, sizeof(T))==0 : var==base;                // and -0 are exact
+      if(!same) mpWriter->write(&var, sizeof(T), "WRITE_DELTA: write error");
+      return !same;
+  }
+
+  bool deltaValue(Serialator& var, Serialator& base);
+
+  template <typename T>
+  typename std::enable_if<std::is_base_of<Serialator,T>::value, bool>::type
+    deltaValue(T& var, T& base){
+      return deltaValue((Serialator&)var, (Serialator&)base);
+  }
+
+  template <typename A>
+  bool deltaValue(std::basic_string<char,std::char_traits<char>,A>& var, 
+                  std::basic_string<char,std::char_traits<char>,A>& base){
+    if(var==base) return false;
+    writeFull(var);
+    return true;
+  }
+
+  /// values without a dedicated delta: compare serialized bytes, write var if different
+  template <typename T>
+  typename std::enable_if<!std::is_arithmetic<T>::value && 
+                          !std::is_base_of<Serialator,T>::value, bool>::type
+    deltaValue(T& var, T& base){
+      std::vector<char> varBytes, baseBytes;
+      BufferWriter varWriter(varBytes), baseWriter(baseBytes);
+      Archive varAr(WRITE_BIN, varWriter), baseAr(WRITE_BIN, baseWriter);
+      varAr & var;
+      baseAr & base;
+      varWriter.finish();
+      baseWriter.finish();
+      if(varBytes==baseBytes) return false;
+      mpWriter->write(varBytes.data(), varBytes.size(), "WRITE_DELTA: write error");
+      return true;
+  }
+
+  template <typename T, typename A>
+  bool deltaValue(std::vector<T,A>& var, std::vector<T,A>& base){
+    if(IsBulk<T>::value) return deltaContiguous(var.data(), var.size(), base.data(), base.size());
+    return deltaSequence(var, base);
+  }
+
+  template <typename T, size_t N>
+  bool deltaValue(std::array<T,N>& var, std::array<T,N>& base){
+    if(IsBulk<T>::value) return deltaContiguous(var.data(), N, base.data(), N);
+    return deltaSequence(var, base);
+  }
+
+  template <typename T, typename A>
+  bool deltaValue(std::deque<T,A>& var, std::deque<T,A>& base){ return deltaSequence(var, base); }
+
+  template <typename T, typename A>
+  bool deltaValue(std::list<T,A>& var, std::list<T,A>& base){ return deltaSequence(var, base); }
+
+  template <typename T1, typename T2, typename C, typename A>
+  bool deltaValue(std::map<T1,T2,C,A>& var, std::map<T1,T2,C,A>& base){ return deltaKeyed(var, base); }
+
+  template <typename T, typename C, typename A>
+  bool deltaValue(std::set<T,C,A>& var, std::set<T,C,A>& base){ return deltaKeyed(var, base); }
+
+  template <typename K, typename T, typename H, typename E, typename A>
+  bool deltaValue(std::unordered_map<K,T,H,E,A>& var, std::unordered_map<K,T,H,E,A>& base){ 
+    return deltaHashed(var, base); 
+  }
+
+  template <typename T, typename H, typename E, typename A>
+  bool deltaValue(std::unordered_set<T,H,E,A>& var, std::unordered_set<T,H,E,A>& base){ 
+    return deltaHashed(var, base); 
+  }
+
+  /// bulk values: runs of changed values in the common part, then the added values
+  template <typename T>
+  bool deltaContiguous(const T* var, size_t size, const T* base, size_t baseSize){
+    const size_t BLOCK = 64;                   // compare this many at once first
+    size_t common = std::min(size, baseSize), last = 0;
+    bool changed = size!=baseSize;
+    writeDeltaVarint(size);
+    writeDeltaVarint(baseSize);
+    for(size_t i=0; i<common; ){
+      if(common-i >= BLOCK && memcmp(var+i, base+i, BLOCK*sizeof(T))==0){ i += BLOCK; continue; }
+      if(memcmp(var+i, base+i, sizeof(T))==0){ i++; continue; }
+      size_t start = i;
+      while(i<common && memcmp(var+i, base+i, sizeof(T))!=0) i++;
+      writeDeltaVarint(start-last+1);
+      writeDeltaVarint(i-start);
+      mpWriter->write(var+start, sizeof(T)*(i-start), "WRITE_DELTA: write error");
+      last = i;
+      changed = true;
+    }
+    writeDeltaVarint(0);
+    if(size>common) mpWriter->write(var+common, sizeof(T)*(size-common), "WRITE_DELTA: write error");
+    return changed;
+  }
+
+  /// other sequences: element changes in the common part, then the added elements
+  template <typename Seq>
+  bool deltaSequence(Seq& var, Seq& base){
+    size_t common = std::min(var.size(), base.size());
+    bool changed = var.size()!=base.size();
+    writeDeltaVarint(var.size());
+    writeDeltaVarint(base.size());
+    typename Seq::iterator i = var.begin(), j = base.begin();
+    uint64_t gap = 0;
+    for(size_t n=0; n<common; n++, ++i, ++j) 
+      if(deltaEntry(*i, *j, gap)) changed = true;
+    writeDeltaVarint(0);
+    for(; i!=var.end(); ++i) writeFull(*i);
+    return changed;
+  }
+
+  /// map/set key of an element
+  template <typename K, typename V>
+  static K& keyOf(std::pair<const K,V>& entry){ return remove_const(entry.first); }
+  template <typename T>
+  static T& keyOf(const T& entry){ return remove_const(entry); }
+
+  /// change to the mapped value of a map entry (set elements have none)
+  template <typename K, typename V>
+  bool deltaMapped(std::pair<const K,V>& var, std::pair<const K,V>& base){ 
+    return deltaValue(var.second, base.second);
+  }
+  template <typename T>
+  bool deltaMapped(const T&, const T&){ return false; }
+
+  /// maps and sets: merge walk of the sorted keys
+  template <typename Keyed>
+  bool deltaKeyed(Keyed& var, Keyed& base){
+    typename Keyed::key_compare less = var.key_comp();
+    typename Keyed::iterator i = var.begin(), j = base.begin();
+    bool changed = false;
+    while(i!=var.end() || j!=base.end()){
+      if(j==base.end() || (i!=var.end() && less(keyOf(*i), keyOf(*j)))){
+        writeDeltaVarint(DELTA_INSERT);
+        writeFull(remove_const(*i++));
+        changed = true;
+      }else if(i==var.end() || less(keyOf(*j), keyOf(*i))){
+        writeDeltaVarint(DELTA_ERASE);
+        writeFull(keyOf(*j++));
+        changed = true;
+      }else{
+        size_t mark = mpWriter->sizeUsed();
+        writeDeltaVarint(DELTA_UPDATE);
+        writeFull(keyOf(*i));
+        if(deltaMapped(remove_const(*i), remove_const(*j))) changed = true;
+        else mpWriter->rewind(mark);
+        ++i, ++j;
+      }
+    }
+    writeDeltaVarint(DELTA_END);
+    return changed;
+  }
+
+  /// hash maps and sets: look up each key in the other container.  Same ops as deltaKeyed,
+  /// the inserts and updates in var's bucket order followed by the erases.
+  template <typename Hashed>
+  bool deltaHashed(Hashed& var, Hashed& base){
+    bool changed = false;
+    for(typename Hashed::iterator i=var.begin(); i!=var.end(); ++i){
+      typename Hashed::iterator j = base.find(keyOf(*i));
+      if(j==base.end()){
+        writeDeltaVarint(DELTA_INSERT);
+        writeFull(remove_const(*i));
+        changed = true;
+        continue;
+      }
+      size_t mark = mpWriter->sizeUsed();
+      writeDeltaVarint(DELTA_UPDATE);
+      writeFull(keyOf(*i));
+      if(deltaMapped(remove_const(*i), remove_const(*j))) changed = true;
+      else mpWriter->rewind(mark);
+    }
+    for(typename Hashed::iterator j=base.begin(); j!=base.end(); ++j){
+      if(var.find(keyOf(*j))!=var.end()) continue;
+      writeDeltaVarint(DELTA_ERASE);
+      writeFull(keyOf(*j));
+      changed = true;
+    }
+    writeDeltaVarint(DELTA_END);
+    return changed;
+  }
+
+  /// apply a change written by deltaValue
+  template <typename T>
+  typename std::enable_if<std::is_arithmetic<T>::value>::type applyDelta(T& var){
+    mpReader->read(&var, sizeof(T), "READ_DELTA: read error");
+  }
+
+  void applyDelta(Serialator& var);
+
+  template <typename T>
+  typename std::enable_if<std::is_base_of<Serialator,T>::value>::type applyDelta(T& var){
+    applyDelta((Serialator&)var);
+  }
+
+  template <typename T>
+  typename std::enable_if<!std::is_arithmetic<T>::value && 
+                          !std::is_base_of<Serialator,T>::value>::type applyDelta(T& var){
+    readFull(var);                             // strings and other whole values
+  }
+
+  template <typename T, typename A>
+  void applyDelta(std::vector<T,A>& var){
+    if(!IsBulk<T>::value){
+      applySequence(var);
+      return;
+    }
+    size_t oldSize = var.size(), size = size_t(readDeltaVarint());
+    checkBaseSize(oldSize);
+    var.resize(size);
+    applyContiguous(var.data(), size, oldSize);
+  }
+
+  template <typename T, size_t N>
+  void applyDelta(std::array<T,N>& var){
+    if(!IsBulk<T>::value){
+      applySequence(var);
+      return;
+    }
+    if(readDeltaVarint()!=N) throw std::runtime_error("READ_DELTA: array size error");
+    checkBaseSize(N);
+    applyContiguous(var.data(), N, N);
+  }
+
+  template <typename T, typename A>
+  void applyDelta(std::deque<T,A>& var){ applySequence(var); }
+
+  template <typename T, typename A>
+  void applyDelta(std::list<T,A>& var){ applySequence(var); }
+
+  template <typename T1, typename T2, typename C, typename A>
+  void applyDelta(std::map<T1,T2,C,A>& var){ applyKeyed(var); }
+
+  template <typename T, typename C, typename A>
+  void applyDelta(std::set<T,C,A>& var){ applyKeyed(var); }
+
+  template <typename K, typename T, typename H, typename E, typename A>
+  void applyDelta(std::unordered_map<K,T,H,E,A>& var){ applyKeyed(var); }
+
+  template <typename T, typename H, typename E, typename A>
+  void applyDelta(std::unordered_set<T,H,E,A>& var){ applyKeyed(var); }
+
+  template <typename T>
+  void applyContiguous(T* var, size_t size, size_t oldSize){
+    size_t common = std::min(size, oldSize), pos = 0;
+    for(uint64_t g; (g = readDeltaVarint())!=0; ){
+      uint64_t run = readDeltaVarint();
+      if(g-1 > common-pos || run > common-pos-(g-1)) 
+        throw std::runtime_error("READ_DELTA: range error");
+      pos += size_t(g-1);
+      mpReader->read(var+pos, sizeof(T)*size_t(run), "READ_DELTA: read error");
+      pos += size_t(run);
+    }
+    if(size>common) mpReader->read(var+common, sizeof(T)*(size-common), "READ_DELTA: read error");
+  }
+
+  template <typename T, typename A>
+  static void resizeSequence(std::deque<T,A>& seq, size_t n){ seq.resize(n); }
+  template <typename T, typename A>
+  static void resizeSequence(std::list<T,A>& seq, size_t n){ seq.resize(n); }
+  template <typename T, typename A>
+  static void resizeSequence(std::vector<T,A>& seq, size_t n){ seq.resize(n); }
+  template <typename T, size_t N>
+  static void resizeSequence(std::array<T,N>&, size_t n){
+    if(n!=N) throw std::runtime_error("READ_DELTA: array size error");
+  }
+
+  /// the sequence sizes in a delta are the new size then the baseline size
+  void checkBaseSize(size_t oldSize){
+    if(readDeltaVarint()!=oldSize) throw std::runtime_error("READ_DELTA: baseline size mismatch");
+  }
+
+  template <typename Seq>
+  void applySequence(Seq& var){
+    size_t oldSize = var.size(), size = size_t(readDeltaVarint());
+    checkBaseSize(oldSize);
+    resizeSequence(var, size);
+    size_t common = std::min(var.size(), oldSize), pos = 0;
+    typename Seq::iterator i = var.begin();
+    Walk walk;
+    for(readGap(walk); !walk.done; readGap(walk)){
+      if(walk.gap >= common-pos) throw std::runtime_error("READ_DELTA: range error");
+      std::advance(i, walk.gap);
+      pos += size_t(walk.gap);
+      applyDelta(*i);
+      ++i, ++pos;
+    }
+    std::advance(i, common-pos);
+    for(; i!=var.end(); ++i) readFull(*i);
+  }
+
+  template <typename K, typename V>
+  void applyMapped(std::pair<const K,V>& entry){ applyDelta(entry.second); }
+  template <typename T>
+  void applyMapped(const T&){ throw std::runtime_error("READ_DELTA: set update error"); }
+
+  template <typename Keyed>
+  void applyKeyed(Keyed& var){
+    typedef AllocElement<typename Keyed::key_type, typename Keyed::allocator_type> Key;
+    typedef AllocElement<typename Keyed::value_type, typename Keyed::allocator_type> Element;
+    for(uint64_t op; (op = readDeltaVarint())!=DELTA_END; ){
+      if(op==DELTA_INSERT){
+        typename Element::type val = Element::make(var.get_allocator());
+        readFull(val);
+        var.insert(std::move(val));
+        continue;
+      }
+      typename Key::type key = Key::make(var.get_allocator());
+      readFull(key);
+      typename Keyed::iterator found = var.find(key);
+      if(found==var.end() || op>DELTA_INSERT) throw std::runtime_error("READ_DELTA: key error");
+      if(op==DELTA_ERASE) var.erase(found);
+      else applyMapped(remove_const(*found));
+    }
+  }
+
+  /// copy base into var
+  template <typename T>
+  typename std::enable_if<std::is_arithmetic<T>::value>::type cloneValue(T& var, T& base){
+    var = base;
+  }
+
+  void cloneValue(Serialator& var, Serialator& base);
+
+  template <typename T>
+  typename std::enable_if<std::is_base_of<Serialator,T>::value>::type cloneValue(T& var, T& base){
+    cloneValue((Serialator&)var, (Serialator&)base);
+  }
+
+  template <typename A>
+  void cloneValue(std::basic_string<char,std::char_traits<char>,A>& var, 
+                  std::basic_string<char,std::char_traits<char>,A>& base){
+    var.assign(base.data(), base.size());      // keeps var's allocator and capacity
+  }
+
+  /// views are copied as views of the same buffer
+  template <typename T>
+  void cloneValue(ArrayView<T>& var, ArrayView<T>& base){ var = base; }
+#ifdef SERIALATOR_CXX17
+  void cloneValue(std::string_view& var, std::string_view& base){ var = base; }
+#endif
+
+  template <typename T1, typename T2>
+  void cloneValue(std::pair<T1,T2>& var, std::pair<T1,T2>& base){
+    cloneValue(remove_const(var.first), remove_const(base.first));
+    cloneValue(var.second, base.second);
+  }
+
+  template <typename T, typename A>
+  void cloneValue(std::vector<T,A>& var, std::vector<T,A>& base){
+    var.resize(base.size());
+    cloneContiguous(var.data(), base.data(), base.size(), 
+                    std::integral_constant<bool, IsBulk<T>::value>());
+  }
+
+  template <typename T, size_t N>
+  void cloneValue(std::array<T,N>& var, std::array<T,N>& base){
+    cloneContiguous(var.data(), base.data(), N, std::integral_constant<bool, IsBulk<T>::value>());
+  }
+
+  template <typename T, typename A>
+  void cloneValue(std::deque<T,A>& var, std::deque<T,A>& base){ cloneSequence(var, base); }
+
+  template <typename T, typename A>
+  void cloneValue(std::list<T,A>& var, std::list<T,A>& base){ cloneSequence(var, base); }
+
+  template <typename T1, typename T2, typename C, typename A>
+  void cloneValue(std::map<T1,T2,C,A>& var, std::map<T1,T2,C,A>& base){ cloneKeyed(var, base); }
+
+  template <typename T, typename C, typename A>
+  void cloneValue(std::set<T,C,A>& var, std::set<T,C,A>& base){ cloneKeyed(var, base); }
+
+  template <typename K, typename T, typename H, typename E, typename A>
+  void cloneValue(std::unordered_map<K,T,H,E,A>& var, std::unordered_map<K,T,H,E,A>& base){ 
+    cloneKeyed(var, base); 
+  }
+
+  template <typename T, typename H, typename E, typename A>
+  void cloneValue(std::unordered_set<T,H,E,A>& var, std::unordered_set<T,H,E,A>& base){ 
+    cloneKeyed(var, base); 
+  }
+
+  /// values without a dedicated copy (e.g. bitwise structs, Lazy): through their default
+  /// binary encoding
+  template <typename T>
+  typename std::enable_if<!std::is_arithmetic<T>::value && 
+                          !std::is_base_of<Serialator,T>::value>::type
+    cloneValue(T& var, T& base){
+      std::vector<char> bytes;
+      BufferWriter writer(bytes);
+      Archive out(WRITE_BIN, writer);
+      out & base;
+      writer.finish();
+      BufferReader reader(bytes.data(), bytes.data()+bytes.size(), true);
+      Archive in(READ_BIN, reader);
+      in & var;
+  }
+
+  /// bulk values: one memcpy, others element by element
+  template <typename T>
+  static void cloneContiguous(T* var, const T* base, size_t size, std::true_type){
+    if(size>0) memcpy(var, base, sizeof(T)*size);
+  }
+  template <typename T>
+  void cloneContiguous(T* var, T* base, size_t size, std::false_type){
+    for(size_t i=0; i<size; i++) cloneValue(var[i], base[i]);
+  }
+
+  template <typename Seq>
+  void cloneSequence(Seq& var, Seq& base){
+    resizeSequence(var, base.size());
+    typename Seq::iterator i = var.begin();
+    for(typename Seq::iterator j=base.begin(); j!=base.end(); ++i, ++j) cloneValue(*i, *j);
+  }
+
+  /// map entries copy key and mapped value into a new element, set elements themselves
+  template <typename K, typename V, typename K2>
+  void cloneEntry(std::pair<K,V>& var, std::pair<K2,V>& base){
+    cloneValue(var.first, remove_const(base.first));
+    cloneValue(var.second, base.second);
+  }
+  template <typename T>
+  void cloneEntry(T& var, const T& base){ cloneValue(var, remove_const(base)); }
+
+  template <typename Keyed>
+  void cloneKeyed(Keyed& var, Keyed& base){
+    typedef AllocElement<typename Keyed::value_type, typename Keyed::allocator_type> Element;
+    var.clear();
+    reserveIf(var, base.size(), 0);
+    for(typename Keyed::iterator j=base.begin(); j!=base.end(); ++j){
+      typename Element::type val = Element::make(var.get_allocator());
+      cloneEntry(val, remove_const(*j));
+      var.insert(var.end(), std::move(val));
+    }
+  }
+
+  /// compare the next field with its recorded counterpart, unless a difference was found.
+  /// A missing or different type field (layout depends on the values) is a difference.
+  template <typename T>
+  void compareField(T& var){
+    if(mpWalk->changed) return;
+    std::vector<Walk::Field>& fields = *mpWalk->fields;
+    size_t at = mpWalk->next++;
+    if(at < fields.size() && *fields[at].type==typeid(var) && 
+       compareValue(var, fieldValue<T>(fields[at])))
+      return;
+    mpWalk->changed = true;
+    prependPath(std::to_string((unsigned long long)(at - mpWalk->first)));
+  }
+
+  /// add part in front of the path to the first difference: field indexes in archive
+  /// order joined by '.', container element positions as [n]
+  void prependPath(const std::string& part){
+    std::string* path = mpWalk->path;
+    if(!path) return;
+    if(path->empty()) *path = part;
+    else if((*path)[0]=='[') path->insert(0, part);
+    else path->insert(0, part + ".");
+  }
+  void prependElement(size_t n){
+    if(mpWalk->path) prependPath("[" + std::to_string((unsigned long long)n) + "]");
+  }
+
+  /// true if var equals base.  Numbers compare bitwise, like their encodings.
+  template <typename T>
+  typename std::enable_if<std::is_arithmetic<T>::value, bool>::type compareValue(T& var, T& base){
+    return std::is_floating_point<T>::value && sizeof(T)<=8 ? 
+      memcmp(&var, &base, sizeof(T))==0 : var==base;
+  }
+
+  bool compareValue(Serialator& var, Serialator& base);
+
+  template <typename T>
+  typename std::enable_if<std::is_base_of<Serialator,T>::value, bool>::type 
+    compareValue(T& var, T& base){
+      return compareValue((Serialator&)var, (Serialator&)base);
+  }
+
+  template <typename A>
+  bool compareValue(std::basic_string<char,std::char_traits<char>,A>& var, 
+                    std::basic_string<char,std::char_traits<char>,A>& base){ return var==base; }
+
+  template <typename T>
+  bool compareValue(ArrayView<T>& var, ArrayView<T>& base){
+    return var.size()==base.size() && (var.size()==0 || 
+      memcmp(var.bytes(), base.bytes(), sizeof(T)*var.size())==0);
+  }
+#ifdef SERIALATOR_CXX17
+  bool compareValue(std::string_view& var, std::string_view& base){ return var==base; }
+#endif
+
+  template <typename T1, typename T2>
+  bool compareValue(std::pair<T1,T2>& var, std::pair<T1,T2>& base){
+    return compareValue(remove_const(var.first), remove_const(base.first)) && 
+      compareValue(var.second, base.second);
+  }
+
+  template <typename T, typename A>
+  bool compareValue(std::vector<T,A>& var, std::vector<T,A>& base){
+    return var.size()==base.size() && compareContiguous(var.data(), base.data(), var.size(),
+      std::integral_constant<bool, IsBulk<T>::value>());
+  }
+
+  template <typename T, size_t N>
+  bool compareValue(std::array<T,N>& var, std::array<T,N>& base){
+    return compareContiguous(var.data(), base.data(), N, std::integral_constant<bool, IsBulk<T>::value>());
+  }
+
+  template <typename T, typename A>
+  bool compareValue(std::deque<T,A>& var, std::deque<T,A>& base){ return compareSequence(var, base); }
+
+  template <typename T, typename A>
+  bool compareValue(std::list<T,A>& var, std::list<T,A>& base){ return compareSequence(var, base); }
+
+  template <typename T1, typename T2, typename C, typename A>
+  bool compareValue(std::map<T1,T2,C,A>& var, std::map<T1,T2,C,A>& base){ 
+    return compareSequence(var, base); 
+  }
+
+  template <typename T, typename C, typename A>
+  bool compareValue(std::set<T,C,A>& var, std::set<T,C,A>& base){ return compareSequence(var, base); }
+
+  template <typename K, typename T, typename H, typename E, typename A>
+  bool compareValue(std::unordered_map<K,T,H,E,A>& var, std::unordered_map<K,T,H,E,A>& base){ 
+    return compareHashed(var, base); 
+  }
+
+  template <typename T, typename H, typename E, typename A>
+  bool compareValue(std::unordered_set<T,H,E,A>& var, std::unordered_set<T,H,E,A>& base){ 
+    return compareHashed(var, base); 
+  }
+
+  /// values without a dedicated comparison: compare their default binary encodings
+  template <typename T>
+  typename std::enable_if<!std::is_arithmetic<T>::value && 
+                          !std::is_base_of<Serialator,T>::value, bool>::type
+    compareValue(T& var, T& base){
+      std::vector<char> varBytes, baseBytes;
+      BufferWriter varWriter(varBytes), baseWriter(baseBytes);
+      Archive varAr(WRITE_BIN, varWriter), baseAr(WRITE_BIN, baseWriter);
+      varAr & var;
+      baseAr & base;
+      varWriter.finish();
+      baseWriter.finish();
+      return varBytes==baseBytes;
+  }
+
+  /// bulk values: one memcmp (then a search for the position if a path is wanted)
+  template <typename T>
+  bool compareContiguous(T* var, T* base, size_t size, std::true_type){
+    if(size==0 || memcmp(var, base, sizeof(T)*size)==0) return true;
+    size_t n = 0;
+    while(memcmp(var+n, base+n, sizeof(T))==0) n++;
+    prependElement(n);
+    return false;
+  }
+  template <typename T>
+  bool compareContiguous(T* var, T* base, size_t size, std::false_type){
+    for(size_t n=0; n<size; n++){
+      if(compareValue(var[n], base[n])) continue;
+      prependElement(n);
+      return false;
+    }
+    return true;
+  }
+
+  /// other sequences, and maps and sets in key order
+  template <typename Seq>
+  bool compareSequence(Seq& var, Seq& base){
+    if(var.size()!=base.size()) return false;
+    typename Seq::iterator i = var.begin(), j = base.begin();
+    for(size_t n=0; i!=var.end(); ++i, ++j, ++n){
+      if(compareValue(remove_const(*i), remove_const(*j))) continue;
+      prependElement(n);
+      return false;
+    }
+    return true;
+  }
+
+  /// mapped value of a map entry (set elements have none)
+  template <typename K, typename V>
+  bool compareMapped(std::pair<const K,V>& var, std::pair<const K,V>& base){ 
+    return compareValue(var.second, base.second);
+  }
+  template <typename T>
+  bool compareMapped(const T&, const T&){ return true; }
+
+  /// hash maps and sets compare as sets, whatever their bucket order
+  template <typename Hashed>
+  bool compareHashed(Hashed& var, Hashed& base){
+    if(var.size()!=base.size()) return false;
+    size_t n = 0;
+    for(typename Hashed::iterator i=var.begin(); i!=var.end(); ++i, ++n){
+      typename Hashed::iterator j = base.find(keyOf(*i));
+      if(j!=base.end() && compareMapped(remove_const(*i), remove_const(*j))) continue;
+      prependElement(n);
+      return false;
+    }
+    return true;
+  }
+};
+
+// combine BinFormat options, e.g. Archive::BIN_COMPACT | Archive::BIN_REUSE
+inline Archive::BinFormat operator| (Archive::BinFormat a, Archive::BinFormat b){
+  return Archive::BinFormat(int(a) | int(b));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// StaticArchive Class
+//   Compile-time specialized counterpart of Archive for the binary raw-buffer, INIT and
+//   SERIAL_SIZE_BIN directions.  The archive type is a template parameter, so every
+//   switch below folds away and an archive method instantiated against one of these
+//   compiles to straight-line code for that direction (see SerialatorT below).
+//   Produces exactly the same binary format as Archive.
+template <Archive::ArchiveType TYPE>
+class StaticArchive{
+public:
+  // Constructors
+  StaticArchive()                                   // For INIT or SERIAL_SIZE_BIN
+    : mpReader(NULL), mpWriter(NULL), mSerializedSize(0) {}
+  explicit StaticArchive(BufferReader& reader)      // For READ_BIN
+    : mpReader(&reader), mpWriter(NULL), mSerializedSize(0) {}
+  explicit StaticArchive(BufferWriter& writer)      // For WRITE_BIN
+    : mpReader(NULL), mpWriter(&writer), mSerializedSize(0) {}
+
+  // operator& for serializing and deserializing strings of any allocator
+  template <typename A>
+  StaticArchive& operator& (std::basic_string<char,std::char_traits<char>,A>& var){
+    SERIALATOR_PROFILE_SCOPE(var);
+    uint32_t size = var.size();
+    if(TYPE==Archive::INIT) var.clear();
+    else{
+      (*this) & size;               // read or write string size
+      var.resize(size);             // resize (if reading)
+      bytes(&var[0], size, "READ_BIN: string read error", "WRITE_BIN: string write error");
+    }
+    return *this;
+  }
+
+  // operator& for serializing and deserializing descendants of Serialator
+  // (defined below Serialator)
+  StaticArchive& operator& (Serialator& ser);
+
+  // operator& for lazily decoded nested objects, through a runtime Archive
+  // (defined below Lazy)
+  StaticArchive& operator& (LazyBase& lazy);
+  template <typename T>
+  StaticArchive& operator& (Lazy<T>& lazy){ return *this & static_cast<LazyBase&>(lazy); }
+
+  // operator& for zero-copy views of arithmetic arrays (see ArrayView)
+  template <typename T>
+  StaticArchive& operator& (ArrayView<T>& view){
+    uint32_t size = view.size();
+    if(TYPE==Archive::INIT) view = ArrayView<T>();
+    else{
+      (*this) & size;
+      if(TYPE==Archive::READ_BIN){
+        view = ArrayView<T>::fromBytes(
+          mpReader->take(sizeof(T)*size, "READ_BIN: \"view\" read error"), size);
+      }
+      else bytes((void*)view.bytes(), sizeof(T)*size, "", "WRITE_BIN: \"view\" write error");
+    }
+    return *this;
+  }
+
+#ifdef SERIALATOR_CXX17
+  // operator& for zero-copy string views, wire compatible with std::string
+  StaticArchive& operator& (std::string_view& var){
+    uint32_t size = var.size();
+    if(TYPE==Archive::INIT) var = std::string_view();
+    else{
+      (*this) & size;
+      if(TYPE==Archive::READ_BIN) 
+        var = std::string_view(mpReader->take(size, "READ_BIN: string read error"), size);
+      else bytes((void*)var.data(), size, "", "WRITE_BIN: string write error");
+    }
+    return *this;
+  }
+#endif
+
+  // operator& for serializing and deserializing vectors
+  template <typename T, typename A>
+  StaticArchive& operator& (std::vector<T,A>& vec){
+    SERIALATOR_PROFILE_SCOPE(vec);
+    if(TYPE==Archive::INIT) vec.clear();
+    else{
+      uint32_t size = vec.size(); // get size (if writing)
+      (*this) & size;             // read or write size
+      vec.resize(size);           // resize (if reading)
+
+      // binary read, write or size of contiguous values
+      if(IsBulk<T>::value){
+        bulkLayout<T>();
+        bytes(vec.data(), sizeof(T)*size, "READ_BIN: \"vector\" read error", 
+          "WRITE_BIN: \"vector\" write error");
+      }else{
+        for(uint32_t i=0;i<size;i++) (*this) & vec[i];
+      }
+    }
+    return *this;
+  }
+
+  // operator& for serializing and deserializing std::array
+  template <typename T, size_t N>
+  StaticArchive& operator& (std::array<T,N>& arr){
+    SERIALATOR_PROFILE_SCOPE(arr);
+    if(TYPE==Archive::INIT) arr.fill(T());
+    else{
+      uint32_t size = arr.size(); // get size (if writing)
+      (*this) & size;             // read or write size
+      if(size > arr.size()) throw std::runtime_error("operator& array size error");
+
+      // binary read, write or size of contiguous values
+      if(IsBulk<T>::value){
+        bulkLayout<T>();
+        bytes(arr.data(), sizeof(T)*size, "READ_BIN: \"array\" read error", 
+          "WRITE_BIN: \"array\" write error");
+      }else{
+        for(uint32_t i=0;i<size;i++) (*this) & arr[i];
+      }
+    }
+    return *this;
+  }
+
+  // operator& for serializing and deserializing maps of any supported types
+  template <typename T1, typename T2, typename C, typename A>
+  StaticArchive& operator& (std::map<T1,T2,C,A>& mp){
+    SERIALATOR_PROFILE_SCOPE(mp);
+    containerHelper(mp);
+    return *this;
+  }
+
+  // operator& for serializing and deserializing sets of any supported types
+  template <typename T, typename C, typename A>
+  StaticArchive& operator& (std::set<T,C,A>& s){
+    SERIALATOR_PROFILE_SCOPE(s);
+    containerHelper(s);
+    return *this;
+  }
+
+  // operator& for serializing and deserializing hash maps of any supported types
+  template <typename K, typename T, typename H, typename E, typename A>
+  StaticArchive& operator& (std::unordered_map<K,T,H,E,A>& mp){
+    SERIALATOR_PROFILE_SCOPE(mp);
+    containerHelper(mp);
+    return *this;
+  }
+
+  // operator& for serializing and deserializing hash sets of any supported types
+  template <typename T, typename H, typename E, typename A>
+  StaticArchive& operator& (std::unordered_set<T,H,E,A>& s){
+    SERIALATOR_PROFILE_SCOPE(s);
+    containerHelper(s);
+    return *this;
+  }
+
+  // operator& for serializing and deserializing lists of any supported types
+  template <typename T, typename A>
+  StaticArchive& operator& (std::list<T,A>& l){
+    SERIALATOR_PROFILE_SCOPE(l);
+    containerHelper(l);
+    return *this;
+  }
+
+  // operator& for serializing and deserializing deques of any supported types
+  // Bulk element types are copied one contiguous chunk at a time.
+  template <typename T, typename A>
+  StaticArchive& operator& (std::deque<T,A>& d){
+    SERIALATOR_PROFILE_SCOPE(d);
+    if(IsBulk<T>::value && TYPE!=Archive::INIT){
+      uint32_t size = d.size(); // get size (if writing)
+      (*this) & size;           // read or write size
+      d.resize(size);           // resize (if reading)
+      bulkLayout<T>();
+      for(uint32_t i=0; i<size; ){
+        uint32_t n = Archive::dequeChunk(d, i);
+        bytes(&d[i], sizeof(T)*n, "READ_BIN: \"deque\" read error", 
+          "WRITE_BIN: \"deque\" write error");
+        i += n;
+      }
+    }
+    else containerHelper(d);
+    return *this;
+  }
+
+  // operator& for serializing and deserializing pairs of any supported types
+  template <typename T1, typename T2>
+  StaticArchive& operator& (std::pair<T1,T2>& pair){
+    (*this) & Archive::remove_const(pair.first) & pair.second;
+    return *this;
+  }
+
+  // operator& for serializing and deserializing basic types (int, float, etc...).
+  // The enable_if is to prevent template from matching descendants of Serialator
+  template <typename T>
+  typename std::enable_if<std::is_arithmetic<T>::value, StaticArchive&>::type
+    operator& (T& var){
+      if(TYPE==Archive::INIT) var = T();
+      else bytes(&var, sizeof(var), "READ_BIN: \"other\" read error", 
+        "WRITE_BIN: \"other\" write error");
+      return *this;
+  }
+
+private:
+
+  // Pointer to raw input buffer (READ_BIN only)
+  BufferReader* mpReader;
+  // Pointer to raw output buffer (WRITE_BIN only)
+  BufferWriter* mpWriter;
+  // Size of serialized data (SERIAL_SIZE_BIN only)
+  size_t mSerializedSize;
+  // friend
+  friend class Serialator;
+
+#ifdef SERIALATOR_PROFILE
+  typedef StaticArchive ProfileSelf;
+  template <typename Ar> friend class ProfileScope;
+  Archive::ArchiveType profileDirection() const { return TYPE; }
+  uint64_t profilePosition() const {
+    return mpWriter ? mpWriter->bytesWritten() : mpReader ? mpReader->sizeUsed() : mSerializedSize;
+  }
+#endif
+
+  /// read, write or count n raw bytes depending on TYPE
+  void bytes(void* data, size_t n, const char* readErr, const char* writeErr){
+    switch(TYPE){
+    case Archive::READ_BIN:        if(n>0) mpReader->read(data, n, readErr);   break;
+    case Archive::WRITE_BIN:       if(n>0) mpWriter->write(data, n, writeErr); break;
+    case Archive::SERIAL_SIZE_BIN: mSerializedSize += n;                       break;
+    default: break;
+    }
+  }
+
+  /// read/write/size the layout tag of a bulk block (no-op for arithmetic types)
+  template <typename T>
+  void bulkLayout(){
+    if(!BitwiseSerializable<T>::value) return;
+    uint32_t tag = Archive::layoutTag<T>();
+    (*this) & tag;
+    if(tag!=Archive::layoutTag<T>()) throw std::runtime_error("READ_BIN: bitwise layout/version mismatch");
+  }
+
+  template <typename Container>
+  void containerHelper(Container& container){
+    uint32_t size;
+
+    switch(TYPE){
+    case Archive::READ_BIN:
+      container.clear();
+      (*this) & size;
+      Archive::reserveFor(container, size, mpReader);
+      for(uint32_t i=0; i<size; i++){
+        typedef AllocElement<typename Container::value_type, 
+                             typename Container::allocator_type> Element;
+        typename Element::type val = Element::make(container.get_allocator());
+        (*this) & val;
+        container.insert(container.end(), std::move(val));
+      }
+      break;
+
+    case Archive::WRITE_BIN:
+    case Archive::SERIAL_SIZE_BIN:
+      size = container.size();
+      (*this) & size;
+      for(typename Container::iterator i=container.begin(); i!=container.end(); i++){
+        (*this) & Archive::remove_const(*i);
+      }
+      break;
+
+    case Archive::INIT:
+      container.clear();
+      break;
+
+    default: 
+      break;
+    }
+  }
+
+  static_assert(TYPE!=Archive::READ_TEXT && TYPE!=Archive::WRITE_TEXT, 
+    "StaticArchive does not support text archive types");
+};
+
+typedef StaticArchive<Archive::INIT>            InitArchive;     // initializer
+typedef StaticArchive<Archive::READ_BIN>        BinReadArchive;  // raw buffer reader
+typedef StaticArchive<Archive::WRITE_BIN>       BinWriteArchive; // raw buffer writer
+typedef StaticArchive<Archive::SERIAL_SIZE_BIN> BinSizeArchive;  // binary sizer
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// Compression options
+//   Passed to the Serialator bin* overloads taking a Compression to run the binary
+//   serialization through the built-in block compressor (see BlockCodec).  The level is
+//   ignored when deserializing.
+struct Compression{
+  explicit Compression(int level=1, size_t blockSize=1<<16) 
+    : level(level), blockSize(blockSize) {}
+  int level;          // 0 stores blocks uncompressed, 1 fastest ... 9 smallest
+  size_t blockSize;   // uncompressed bytes per block
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// BlockCodec class
+//   Built-in LZ77 block codec.  The serialized bytes are cut into blocks as Archive
+//   writes them and each block is compressed on its own, so the uncompressed output is
+//   never held in memory as a whole.  Compressed stream layout (host byte order):
+//     header : uint32 magic "SLZ1"
+//     block  : uint32 raw size, uint32 stored size (STORED bit set if not compressed),
+//              stored bytes
+//     end    : uint32 0, uint32 0
+//   Within a block, sequences are: token (literal count << 4 | match length-4), extra
+//   literal count bytes, literals, uint16 match offset, extra match length bytes (LZ4
+//   style, counts of 15 continue in following bytes while they are 255).  The last
+//   sequence of a block has no match.  Blocks are independent, so they can be
+//   decompressed in parallel from the list returned by scan().
+class BlockCodec{
+public:
+  static const uint32_t MAGIC = 0x315a4c53;   // "SLZ1"
+  static const uint32_t STORED = 0x80000000;  // stored size flag, block not compressed
+  static const size_t MAX_BLOCK = 1<<24;
+
+  struct Block{
+    const char* data;       // stored bytes
+    uint32_t storedSize;
+    uint32_t rawSize;
+    bool compressed;
+    size_t rawOffset;       // offset of the block in the decompressed output
+  };
+
+  // Compress n bytes from src into dst (n+16 bytes long).  Returns the compressed size,
+  // or 0 if the block doesn't shrink and should be stored.
+  size_t compressBlock(const char* src, size_t n, char* dst, int level);
+
+  // Parse the 8 byte header at p into block (data and rawOffset not set).  Returns
+  // false for the end marker, throws if the header is invalid.
+  static bool blockHeader(const char* p, Block& block);
+
+  // Decompress one block into dst (block.rawSize bytes), throws if corrupt
+  static void decompressBlock(const Block& block, char* dst);
+
+  // List the blocks of the compressed stream at data, returns the decompressed size.
+  // If used is given it gets the compressed stream size.  Throws if malformed.
+  static size_t scan(const char* data, size_t size, std::vector<Block>& blocks, 
+                     size_t* used=NULL);
+
+  // Decompress a whole stream into out
+  static void decompress(const char* data, size_t size, std::vector<char>& out);
+
+private:
+  std::vector<uint32_t> mHead;  // match finder hash table
+  std::vector<uint32_t> mPrev;  // match finder hash chains (levels above 1)
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// MappedFile class
+//   Read-only memory mapping of a whole file, used by binDeserializeFile and
+//   textDeserializeFile to parse a file in place with sequential read-ahead hints.
+//   Can also be used directly with binDeserialize(const MappedFile&) so that zero-copy 
+//   views stay valid for the lifetime of the MappedFile.
+//   isMapped() is false if the file can't be opened or mapped, or on platforms without
+//   mmap; callers then fall back to streaming.
+class MappedFile{
+public:
+  explicit MappedFile(const std::string& filename);
+  ~MappedFile();
+
+  bool isMapped() const { return mpData!=NULL; }
+  const char* data() const { return mpData; }
+  size_t size() const { return mSize; }
+
+private:
+  MappedFile(const MappedFile&);            // not copyable
+  MappedFile& operator=(const MappedFile&);
+
+  const char* mpData;
+  size_t mSize;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// Serialator class
+//   Descendants of this class should implement archive method which is called by all 
+//   of the public methods
+class Serialator{
+public:
+  void initAll();                         // init all elements to type default
+  
+  // Serialize/deserialize to/from stream
+  void textSerialize  (std::ostream&os);  // serialize to text stream 
+  void textDeserialize(std::istream&is);  // deserialize from text stream
+  void binSerialize   (std::ostream&os);  // serialize to binary stream
+  void binDeserialize (std::istream&is);  // deserialize from binary stream
+
+  // Serialize/deserialize to/from char* (serialize returns size used)
+  int  textSerialize  (      char* blob, int maxBlobSize);   
+  void textDeserialize(const char* blob, int blobSize); 
+  int  binSerialize   (      char* blob, int maxBlobSize);    
+  void binDeserialize (const char* blob, int blobSize);  
+
+  // Serialize/deserialize to/from vector<char>
+  void textSerialize  (      std::vector<char>& blob);   
+  void textDeserialize(const std::vector<char>& blob); 
+  void binSerialize   (      std::vector<char>& blob, size_t capacityHint=0);    
+  void binDeserialize (const std::vector<char>& blob);  
+
+  // Append binary serialization to the end of blob in a single pass, returns size added.
+  // Reusing the same blob across calls (clear() keeps capacity) avoids reallocation.
+  size_t binSerializeAppend(std::vector<char>& blob, size_t capacityHint=0);
+
+  // Size in bytes of the binary serialization (default format)
+  size_t binSerializedSize();
+
+  // Serialize/deserialize to/from file
+  void textSerializeFile  (const std::string& filename);   
+  void textDeserializeFile(const std::string& filename); 
   void binSerializeFile   (const std::string& filename);    
   void binDeserializeFile (const std::string& filename);  
 
+  // Deserialize from a memory mapped file.  Zero-copy views (ArrayView, string_view)
+  // point into the mapping and stay valid while file is alive.
+  void binDeserialize (const MappedFile& file);
+
+  // Binary serialize/deserialize with format options (see Archive::BinFormat)
+  // e.g. obj.binSerialize(blob, Archive::BIN_COMPACT)
+  void binSerialize      (std::ostream& os, Archive::BinFormat format);
+  void binDeserialize    (std::istream& is, Archive::BinFormat format);
+  int  binSerialize      (      char* blob, int maxBlobSize, Archive::BinFormat format);
+  void binDeserialize    (const char* blob, int blobSize,    Archive::BinFormat format);
+  void binSerialize      (      std::vector<char>& blob, Archive::BinFormat format, 
+                          size_t capacityHint=0);
+  void binDeserialize    (const std::vector<char>& blob, Archive::BinFormat format);
+  void binSerializeFile  (const std::string& filename, Archive::BinFormat format);
+  void binDeserializeFile(const std::string& filename, Archive::BinFormat format);
+
+  // Delta serialization against a baseline object of the same class.  Writes only the
+  // fields and container elements that differ from base (returns the delta size).
+  // binApplyDelta updates an object equal to that baseline in place.
+  size_t binSerializeDelta(Serialator& base, std::vector<char>& delta);
+  void   binApplyDelta    (const std::vector<char>& delta);
+  void   binApplyDelta    (const char* delta, int deltaSize);
+
+  // 64-bit XXH64 of the binary serialization, computed as it is encoded without holding
+  // it in memory.  Equal to Xxh64::compute over binSerialize's output in the same format
+  // (BIN_CHECKED output is encoded in memory first, its header is filled in afterwards).
+  uint64_t binHash();
+  uint64_t binHash(Archive::BinFormat format);
+
+  // Field by field comparison with other through archive(), without encoding either.
+  // Equal when their binary encodings would be, except that hash containers compare as
+  // sets.  Stops at the first difference.  If path is given it is set to where that is:
+  // field indexes in archive order joined by '.', and container elements as [position],
+  // e.g. "5[17].0" (empty if other is another class).
+  bool equals(Serialator& other, std::string* path=NULL);
+
+  // Deep copy of source, an object of the same class, field by field through archive().
+  // Works behind Serialator& and without a copy constructor.  No intermediate buffer, 
+  // bulk vectors and arrays are copied with memcpy.
+  void cloneFrom(Serialator& source);
+
+  // Binary serialize/deserialize through the block compressor (see BlockCodec)
+  // e.g. obj.binSerializeFile("snapshot.bin", Compression(3))
+  // Zero-copy views can't be deserialized from compressed data.
+  void binSerialize      (std::ostream& os, const Compression& comp);
+  void binDeserialize    (std::istream& is, const Compression& comp);
+  void binSerialize      (      std::vector<char>& blob, const Compression& comp);
+  void binDeserialize    (const std::vector<char>& blob, const Compression& comp);
+  void binSerializeFile  (const std::string& filename, const Compression& comp);
+  void binDeserializeFile(const std::string& filename, const Compression& comp);
+
   // Version number allowing for backward compatibility.
   // Override this method to change version number.
   // This number is automatically written and read from stream
@@ -324,9 +2616,183 @@ protected:
   // This method should be implemented in descendant class
   virtual void archive(Archive& ar, int32_t structVersion) =0;
 
+  // Compile-time specialized entry points used by the StaticArchive family.
+  // The defaults adapt to archive(Archive&,int32_t) above, so existing classes
+  // keep working unchanged.  SerialatorT overrides them.
+  virtual void archiveStatic(InitArchive& ar,     int32_t structVersion);
+  virtual void archiveStatic(BinReadArchive& ar,  int32_t structVersion);
+  virtual void archiveStatic(BinWriteArchive& ar, int32_t structVersion);
+  virtual void archiveStatic(BinSizeArchive& ar,  int32_t structVersion);
+
   // Allow Archive to access protected methods
   friend class Archive;
+  friend class LazyBase;
+  template <Archive::ArchiveType TYPE> friend class StaticArchive;
+
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// SerialatorT class
+//   Optional CRTP base for classes that implement archive as a template:
+//
+//     class Fast : public SerialatorT<Fast>{
+//     public:
+//       template <typename Ar> void archive(Ar& ar, int32_t version){ ar & x & y; }
+//     };
+//
+//   The template is instantiated against Archive and each StaticArchive, so the binary
+//   char*/vector<char> paths and initAll run without the runtime ArchiveType switch.
+//   The templated archive must be public or Derived must befriend SerialatorT<Derived>.
+template <typename Derived>
+class SerialatorT : public Serialator{
+protected:
+  void archive      (Archive& ar,         int32_t v){ derived().archive(ar, v); }
+  void archiveStatic(InitArchive& ar,     int32_t v){ derived().archive(ar, v); }
+  void archiveStatic(BinReadArchive& ar,  int32_t v){ derived().archive(ar, v); }
+  void archiveStatic(BinWriteArchive& ar, int32_t v){ derived().archive(ar, v); }
+  void archiveStatic(BinSizeArchive& ar,  int32_t v){ derived().archive(ar, v); }
+
+private:
+  Derived& derived(){ return static_cast<Derived&>(*this); }
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// SkipNested class
+//   Placeholder member for a nested Serialator a reader doesn't need.  With BIN_FRAMED
+//   reading it jumps over the whole framed object without parsing it.  It is written as
+//   an empty object, so without BIN_FRAMED it only matches an empty one.
+class SkipNested : public Serialator{
+protected:
+  void archive(Archive&, int32_t){}
+};
+
+// operator& for serializing and deserializing descendants of Serialator
+template <Archive::ArchiveType TYPE>
+StaticArchive<TYPE>& StaticArchive<TYPE>::operator& (Serialator& ser){
+  SERIALATOR_PROFILE_SCOPE(ser);
+  int32_t version = ser.getStructVersion();
+  if(TYPE!=Archive::INIT) *this & version;  // read or write version number (if not init)
+  ser.archiveStatic(*this, version);
+  return *this;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// Lazy class
+//   Member wrapper for a nested Serialator that is decoded on first access.  Reading
+//   from a char*, vector<char>, MappedFile or RecordLogReader only records where the
+//   object's bytes are, so the cost is proportional to the members actually used.  The
+//   buffer must stay alive and unmodified until then, as for zero-copy views.  Streams
+//   and temporary buffers (compressed input, binDeserializeFile's own mapping) decode
+//   right away.  Writing an object that was never decoded copies its recorded bytes.
+//
+//   On the wire it is a framed object (version, uint32 byte length, fields) in every
+//   format, so with BIN_FRAMED a Lazy<T> member reads and writes the same as a T.
+class LazyBase{
+public:
+  bool pending() const { return mpData!=NULL; }   // recorded but not decoded yet
+
+  virtual ~LazyBase(){}
+
+protected:
+  LazyBase() : mpData(NULL), mSize(0), mVersion(0), mFormat(Archive::BIN_DEFAULT) {}
+
+  void decode();                         // decode the recorded bytes into value()
+  void discard(){ mpData = NULL; }       // forget the recorded bytes
+  virtual Serialator& value() = 0;
+
+private:
+  const char* mpData;                    // recorded fields (after version and length)
+  uint32_t mSize;
+  int32_t mVersion;                      // struct version read with them
+  Archive::BinFormat mFormat;            // format they were written in
+  friend class Archive;
+};
+
+template <typename T>
+class Lazy : public LazyBase{
+public:
+  Lazy() {}
+  Lazy(const T& value) : mValue(value) {}
+  Lazy& operator=(const T& value){ discard(); mValue = value; return *this; }
+
+  // decoded object (decoded now if still pending)
+  T& get(){ if(pending()) decode(); return mValue; }
+  T& operator*(){ return get(); }
+  T* operator->(){ return &get(); }
+
+private:
+  Serialator& value(){ return mValue; }
+  T mValue;
+};
 
+#ifdef SERIALATOR_PROFILE
+///////////////////////////////////////////////////////////////////////////////////////////
+// Profiler (compiled in with -DSERIALATOR_PROFILE)
+//   Counts, per archive direction, how often each nested Serialator type, string and
+//   container type is archived, the bytes it took and the time spent in it.  Totals are
+//   kept across calls and threads.  Bytes and time include nested members.  Bytes are
+//   counted for the char*, vector, file and size paths, stream archives only get time.
+struct ProfileEntry{
+  Archive::ArchiveType direction;
+  std::string type;                      // type name, demangled where possible
+  uint64_t calls;
+  uint64_t bytes;
+  uint64_t nanos;
+};
+
+class Profiler{
+public:
+  static void record(Archive::ArchiveType direction, const std::type_info& type, 
+                     uint64_t bytes, uint64_t nanos);
+
+  static std::vector<ProfileEntry> report();   // totals so far, most time first
+  static void print(std::ostream& os);         // report() as a flat text table
+  static void reset();
+
+  // call fn(const ProfileEntry&) for each entry of report()
+  template <typename Fn>
+  static void forEach(Fn fn){
+    std::vector<ProfileEntry> entries = report();
+    for(size_t i=0; i<entries.size(); i++) fn(entries[i]);
+  }
+};
+
+// Times and measures one operator& call on archive Ar
+template <typename Ar>
+class ProfileScope{
+public:
+  ProfileScope(Ar& ar, const std::type_info& type) 
+    : mAr(ar), mType(type), mStart(ar.profilePosition()), 
+      mTime(std::chrono::steady_clock::now()) {}
+  ~ProfileScope(){
+    uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - mTime).count();
+    Profiler::record(mAr.profileDirection(), mType, mAr.profilePosition() - mStart, nanos);
+  }
+private:
+  ProfileScope(const ProfileScope&);
+  ProfileScope& operator=(const ProfileScope&);
+  Ar& mAr;
+  const std::type_info& mType;
+  uint64_t mStart;
+  std::chrono::steady_clock::time_point mTime;
 };
+#endif
+
+// operator& for lazily decoded nested objects
+template <Archive::ArchiveType TYPE>
+StaticArchive<TYPE>& StaticArchive<TYPE>::operator& (LazyBase& lazy){
+  switch(TYPE){
+  case Archive::READ_BIN:  { Archive ar(TYPE, *mpReader); ar & lazy; break; }
+  case Archive::WRITE_BIN: { Archive ar(TYPE, *mpWriter); ar & lazy; break; }
+  default:{
+    Archive ar(TYPE);
+    ar & lazy;
+    mSerializedSize += ar.mSerializedSize;
+    break;
+  }
+  }
+  return *this;
+}
 
 }; //end namespace codepi
@@ -0,0 +1,262 @@
+// Throughput/latency benchmark for Serialator.
+//
+// Measures bin and text serialize/deserialize through the stream, char*,
+// vector<char> and file entry points, cloneFrom, binHash and equals, for payloads
+// built from every type Archive supports.  Output is CSV on stdout, one row per measurement:
+//
+//   payload,elems,format,path,op,bytes,iters,ns_per_obj,mb_per_s
+//
+// Usage: BenchSerialator [--max-bytes N] [--min-time SEC] [--filter STR]
+//   --max-bytes  largest payload to generate (default 64MB, use e.g. 4e9 for multi-GB)
+//   --min-time   minimum time spent per measurement in seconds (default 0.2)
+//   --filter     only run payloads whose name contains STR
+
+#include <string>
+#include <vector>
+#include <array>
+#include <map>
+#include <set>
+#include <list>
+#include <deque>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include <memory>
+#include <functional>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include "../Serialator.h"
+
+using namespace std;
+using namespace codepi;
+
+///////////////////////////////////////////////////////////////////////////////
+// Payloads.  Each has fill(n) to populate n elements and bytesPerElem()
+// giving a rough binary size per element used to pick sizes.
+
+struct Tiny : public Serialator{
+  int32_t id; float value; string name;
+  void fill(size_t){ id = 42; value = 3.5f; name = "tiny"; }
+  static size_t bytesPerElem(){ return 16; }
+protected:
+  void archive(Archive& ar, int version){ ar & id & value & name; }
+};
+
+struct VecInt : public Serialator{
+  vector<int32_t> v;
+  void fill(size_t n){ v.resize(n); for(size_t i=0;i<n;i++) v[i] = int32_t(i*2654435761u); }
+  static size_t bytesPerElem(){ return sizeof(int32_t); }
+protected:
+  void archive(Archive& ar, int version){ ar & v; }
+};
+
+struct VecDouble : public Serialator{
+  vector<double> v;
+  void fill(size_t n){ v.resize(n); for(size_t i=0;i<n;i++) v[i] = i*0.25; }
+  static size_t bytesPerElem(){ return sizeof(double); }
+protected:
+  void archive(Archive& ar, int version){ ar & v; }
+};
+
+struct Arrays : public Serialator{
+  vector<array<float,16> > v;
+  void fill(size_t n){ v.resize(n); for(size_t i=0;i<n;i++) v[i].fill(float(i)); }
+  static size_t bytesPerElem(){ return 4+16*sizeof(float); }
+protected:
+  void archive(Archive& ar, int version){ ar & v; }
+};
+
+struct MapStrInt : public Serialator{
+  map<string,int32_t> m;
+  void fill(size_t n){ m.clear(); for(size_t i=0;i<n;i++) m["key_" + to_string(i)] = int32_t(i); }
+  static size_t bytesPerElem(){ return 4+12+4; }
+protected:
+  void archive(Archive& ar, int version){ ar & m; }
+};
+
+struct SetInt : public Serialator{
+  set<int32_t> s;
+  void fill(size_t n){ s.clear(); for(size_t i=0;i<n;i++) s.insert(int32_t(i)); }
+  static size_t bytesPerElem(){ return sizeof(int32_t); }
+protected:
+  void archive(Archive& ar, int version){ ar & s; }
+};
+
+struct ListInt : public Serialator{
+  list<int32_t> l;
+  void fill(size_t n){ l.assign(n, 7); }
+  static size_t bytesPerElem(){ return sizeof(int32_t); }
+protected:
+  void archive(Archive& ar, int version){ ar & l; }
+};
+
+struct DequeInt : public Serialator{
+  deque<int32_t> d;
+  void fill(size_t n){ d.assign(n, 7); }
+  static size_t bytesPerElem(){ return sizeof(int32_t); }
+protected:
+  void archive(Archive& ar, int version){ ar & d; }
+};
+
+struct Point : public Serialator{
+  float x, y, z;
+protected:
+  void archive(Archive& ar, int version){ ar & x & y & z; }
+};
+
+struct VecNested : public Serialator{
+  vector<Point> v;
+  void fill(size_t n){ v.resize(n); for(size_t i=0;i<n;i++){ v[i].x = v[i].y = v[i].z = float(i); } }
+  static size_t bytesPerElem(){ return 4+3*sizeof(float); }
+protected:
+  void archive(Archive& ar, int version){ ar & v; }
+};
+
+struct VecString : public Serialator{
+  vector<string> v;
+  void fill(size_t n){ v.resize(n); for(size_t i=0;i<n;i++) v[i] = "string number " + to_string(i); }
+  static size_t bytesPerElem(){ return 4+20; }
+protected:
+  void archive(Archive& ar, int version){ ar & v; }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Timing helpers
+
+struct Options{
+  double maxBytes;
+  double minTime;
+  string filter;
+  Options() : maxBytes(64e6), minTime(0.2) {}
+};
+
+static double nowSec(){
+  return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// run fn until minTime has elapsed (at least once), return seconds per call
+static double timeIt(const function<void()>& fn, double minTime, long& iters){
+  iters = 0;
+  double start = nowSec(), elapsed = 0;
+  do{
+    fn();
+    iters++;
+    elapsed = nowSec() - start;
+  }while(elapsed < minTime);
+  return elapsed / iters;
+}
+
+static void report(const string& payload, size_t elems, const char* format, const char* path,
+                   const char* op, size_t bytes, long iters, double secPerObj){
+  double mbps = secPerObj>0 ? bytes / secPerObj / 1e6 : 0;
+  printf("%s,%zu,%s,%s,%s,%zu,%ld,%.1f,%.2f\n", payload.c_str(), elems, format, path, op,
+         bytes, iters, secPerObj*1e9, mbps);
+  fflush(stdout);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Run every entry point for one populated source object
+
+static void benchEntryPoints(const string& name, size_t elems, Serialator& src, Serialator& dst,
+                             const Options& opt){
+  const char* fileName = "bench.tmp";
+  long iters;
+  double t;
+
+  for(int text=0; text<2; text++){
+    const char* format = text ? "text" : "bin";
+
+    // vector<char>
+    vector<char> buff;
+    if(text) src.textSerialize(buff); else src.binSerialize(buff);
+    size_t bytes = buff.size();
+    t = timeIt([&]{ if(text) src.textSerialize(buff); else src.binSerialize(buff); }, opt.minTime, iters);
+    report(name, elems, format, "vector", "serialize", bytes, iters, t);
+    t = timeIt([&]{ if(text) dst.textDeserialize(buff); else dst.binDeserialize(buff); }, opt.minTime, iters);
+    report(name, elems, format, "vector", "deserialize", bytes, iters, t);
+
+    // char* (int sized API)
+    if(bytes < INT_MAX){
+      int maxSize = int(bytes) + 1;
+      vector<char> blob(maxSize);
+      t = timeIt([&]{ if(text) src.textSerialize(blob.data(), maxSize);
+                      else src.binSerialize(blob.data(), maxSize); }, opt.minTime, iters);
+      report(name, elems, format, "char*", "serialize", bytes, iters, t);
+      t = timeIt([&]{ if(text) dst.textDeserialize(blob.data(), maxSize);
+                      else dst.binDeserialize(blob.data(), maxSize); }, opt.minTime, iters);
+      report(name, elems, format, "char*", "deserialize", bytes, iters, t);
+    }
+
+    // stream
+    stringstream ss;
+    t = timeIt([&]{ ss.str(string()); ss.clear();
+                    if(text) src.textSerialize(ss); else src.binSerialize(ss); }, opt.minTime, iters);
+    report(name, elems, format, "stream", "serialize", bytes, iters, t);
+    t = timeIt([&]{ ss.clear(); ss.seekg(0);
+                    if(text) dst.textDeserialize(ss); else dst.binDeserialize(ss); }, opt.minTime, iters);
+    report(name, elems, format, "stream", "deserialize", bytes, iters, t);
+
+    // file
+    t = timeIt([&]{ if(text) src.textSerializeFile(fileName);
+                    else src.binSerializeFile(fileName); }, opt.minTime, iters);
+    report(name, elems, format, "file", "serialize", bytes, iters, t);
+    t = timeIt([&]{ if(text) dst.textDeserializeFile(fileName);
+                    else dst.binDeserializeFile(fileName); }, opt.minTime, iters);
+    report(name, elems, format, "file", "deserialize", bytes, iters, t);
+  }
+  remove(fileName);
+
+  // deep copy through archive(), compare with vector serialize + deserialize above
+  t = timeIt([&]{ dst.cloneFrom(src); }, opt.minTime, iters);
+  report(name, elems, "bin", "archive", "clone", src.binSerializedSize(), iters, t);
+  t = timeIt([&]{ src.binHash(); }, opt.minTime, iters);
+  report(name, elems, "bin", "archive", "hash", src.binSerializedSize(), iters, t);
+  dst.cloneFrom(src);                     // equal, so every field is compared
+  t = timeIt([&]{ src.equals(dst); }, opt.minTime, iters);
+  report(name, elems, "bin", "archive", "compare", src.binSerializedSize(), iters, t);
+}
+
+// Run a payload type at element counts from 1 up to maxBytes, growing 16x per step
+template <typename P>
+static void benchPayload(const string& name, const Options& opt){
+  if(name.find(opt.filter)==string::npos) return;
+  for(double elems=1; elems*P::bytesPerElem() <= opt.maxBytes; elems*=16){
+    unique_ptr<P> src(new P), dst(new P);
+    src->initAll();
+    src->fill(size_t(elems));
+    benchEntryPoints(name, size_t(elems), *src, *dst, opt);
+  }
+}
+
+int main(int argc, char** argv){
+  Options opt;
+  for(int i=1; i+1<argc; i+=2){
+    string arg = argv[i];
+    if(arg=="--max-bytes") opt.maxBytes = atof(argv[i+1]);
+    else if(arg=="--min-time") opt.minTime = atof(argv[i+1]);
+    else if(arg=="--filter") opt.filter = argv[i+1];
+    else{ cerr << "unknown option " << arg << endl; return 1; }
+  }
+
+  printf("payload,elems,format,path,op,bytes,iters,ns_per_obj,mb_per_s\n");
+  try{
+    Options tinyOpt = opt;
+    tinyOpt.maxBytes = Tiny::bytesPerElem(); // single object only
+    benchPayload<Tiny>("tiny", tinyOpt);
+    benchPayload<VecInt>("vector_int", opt);
+    benchPayload<VecDouble>("vector_double", opt);
+    benchPayload<Arrays>("array_float16", opt);
+    benchPayload<MapStrInt>("map_string_int", opt);
+    benchPayload<SetInt>("set_int", opt);
+    benchPayload<ListInt>("list_int", opt);
+    benchPayload<DequeInt>("deque_int", opt);
+    benchPayload<VecNested>("vector_nested", opt);
+    benchPayload<VecString>("vector_string", opt);
+  }catch(exception&e){
+    cerr << e.what() << endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,123 @@
+#include <sstream>
+#include <fstream>
+#include <string>
+#include "../AsyncFileWriter.h"
+
+using namespace std;
+using namespace codepi;
+
+class Snapshot : public Serialator{
+public:
+  int seq;
+  string name;
+  vector<double> prices;
+  map<int,string> notes;
+protected:
+  void archive(Archive& ar, int version){
+    ar & seq & name & prices & notes;
+  }
+};
+
+static Snapshot makeSnapshot(int seq, size_t n){
+  Snapshot s;
+  s.seq = seq;
+  s.name = "snapshot " + to_string(seq);
+  for(size_t i=0;i<n;i++) s.prices.push_back(seq + i*0.25);
+  for(int i=0;i<100;i++) s.notes[i] = "note " + to_string(i*seq);
+  return s;
+}
+
+static bool sameSnapshot(const Snapshot& a, const Snapshot& b){
+  return a.seq==b.seq && a.name==b.name && a.prices==b.prices && a.notes==b.notes;
+}
+
+static bool fileExists(const string& name){
+  ifstream ifs(name.c_str());
+  return !ifs.fail();
+}
+
+static size_t fileSize(const string& name){
+  ifstream ifs(name.c_str(), ios::binary | ios::ate);
+  return size_t(ifs.tellg());
+}
+
+class Thrower : public Serialator{
+protected:
+  void archive(Archive& ar, int version){
+    vector<double> filler(100000, 1.0);
+    ar & filler;                          // a few blocks get queued first
+    throw runtime_error("Thrower");
+  }
+};
+
+int main(){
+  try{
+
+    // test objects spanning many small blocks, with and without O_DIRECT
+    {
+      int options[] = { AsyncFileWriter::ASYNC_DEFAULT,
+                        AsyncFileWriter::ASYNC_DIRECT | AsyncFileWriter::ASYNC_SYNC };
+      bool same = true;
+      for(int o=0; o<2; o++){
+        AsyncFileWriter writer(options[o], 8192, 2);
+        Snapshot snap = makeSnapshot(o+1, 100000);
+        future<void> done = writer.binSerializeFile(snap, "async.bin");
+        snap.prices.clear();                // object is free as soon as the call returns
+        done.get();
+        Snapshot expect = makeSnapshot(o+1, 100000), back;
+        back.binDeserializeFile("async.bin");
+        same = same && sameSnapshot(expect, back) && fileSize("async.bin")==expect.binSerializedSize()
+          && !fileExists("async.bin.tmp");
+      }
+      if(!same) cerr << "asyncWrite not equal\n";
+      else cout << "Test asyncWrite passed\n";
+    }
+
+    // test queued files in call order, format options, and replacing an existing file
+    {
+      AsyncFileWriter writer(AsyncFileWriter::ASYNC_SYNC, 4096, 3);
+      vector<future<void> > done;
+      for(int i=0;i<5;i++){
+        Snapshot snap = makeSnapshot(i, 1000*i);
+        done.push_back(writer.binSerializeFile(snap, "async" + to_string(i) + ".bin"));
+      }
+      Snapshot checked = makeSnapshot(9, 50000);
+      done.push_back(writer.binSerializeFile(checked, "async0.bin",
+                                             Archive::BIN_CHECKED | Archive::BIN_COMPACT));
+      writer.wait();
+      bool same = true;
+      for(size_t i=0;i<done.size();i++) done[i].get();
+      for(int i=1;i<5;i++){
+        Snapshot back;
+        back.binDeserializeFile("async" + to_string(i) + ".bin");
+        same = same && sameSnapshot(makeSnapshot(i, 1000*i), back);
+      }
+      Snapshot back;
+      back.binDeserializeFile("async0.bin", Archive::BIN_CHECKED | Archive::BIN_COMPACT);
+      same = same && sameSnapshot(checked, back);
+      for(int i=0;i<5;i++) remove(("async" + to_string(i) + ".bin").c_str());
+      if(!same) cerr << "asyncQueue not equal\n";
+      else cout << "Test asyncQueue passed\n";
+    }
+
+    // test failures: encoding errors throw and keep the old file, open errors throw
+    {
+      AsyncFileWriter writer(AsyncFileWriter::ASYNC_DEFAULT, 4096, 2);
+      Thrower thrower;
+      bool encodeCaught = false, openCaught = false;
+      try{ writer.binSerializeFile(thrower, "async.bin"); }
+      catch(runtime_error& e){ encodeCaught = string(e.what())=="Thrower"; }
+      writer.wait();
+      Snapshot back;
+      back.binDeserializeFile("async.bin");   // still the last good snapshot
+      bool kept = sameSnapshot(makeSnapshot(2, 100000), back) && !fileExists("async.bin.tmp");
+      try{ writer.binSerializeFile(back, "no/such/dir/async.bin"); }
+      catch(runtime_error&){ openCaught = true; }
+      if(!encodeCaught || !openCaught || !kept) cerr << "asyncError not equal\n";
+      else cout << "Test asyncError passed\n";
+    }
+
+  }catch(exception&e){
+    cerr << e.what() << endl;
+  }
+}
@@ -0,0 +1,134 @@
+#include <sstream>
+#include <string>
+#include <memory>
+#include "../ParallelBatch.h"
+
+using namespace std;
+using namespace codepi;
+
+class Tick : public Serialator{
+public:
+  int seq;
+  string symbol;
+  vector<double> prices;
+protected:
+  void archive(Archive& ar, int version){
+    ar & seq & symbol & prices;
+  }
+};
+
+static Tick makeTick(int i){
+  Tick t;
+  t.seq = i;
+  t.symbol = "SYM" + to_string(i % 7);
+  t.prices.assign(i % 50, i * 0.5);
+  return t;
+}
+
+static bool sameTick(const Tick& a, const Tick& b){
+  return a.seq==b.seq && a.symbol==b.symbol && a.prices==b.prices;
+}
+
+class Thrower : public Serialator{
+protected:
+  void archive(Archive& ar, int version){
+    throw runtime_error("Thrower");
+  }
+};
+
+int main(){
+  try{
+
+    // test batch of objects against single threaded serialization
+    {
+      vector<Tick> ticks;
+      for(int i=0;i<10000;i++) ticks.push_back(makeTick(i));
+      vector<char> blob;
+      vector<uint64_t> offsets;
+      binSerializeBatch(ticks.begin(), ticks.end(), blob, offsets, 4);
+
+      vector<char> expect, one;
+      for(size_t i=0;i<ticks.size();i++){
+        ticks[i].binSerialize(one);
+        expect.insert(expect.end(), one.begin(), one.end());
+      }
+      bool offsetsOk = offsets.size()==ticks.size()+1 && offsets[0]==0 && offsets.back()==blob.size();
+
+      vector<Tick> ticks2(ticks.size());
+      binDeserializeBatch(blob, offsets, ticks2.begin(), 4);
+      bool same = true;
+      for(size_t i=0;i<ticks.size();i++) same = same && sameTick(ticks[i], ticks2[i]);
+
+      if(!offsetsOk || blob!=expect || !same) cerr << "batch not equal\n";
+      else cout << "Test batch passed\n";
+    }
+
+    // test batch of pointers, default thread count
+    {
+      vector<unique_ptr<Tick> > owned;
+      vector<Serialator*> ptrs, ptrs2;
+      for(int i=0;i<1000;i++){
+        owned.push_back(unique_ptr<Tick>(new Tick(makeTick(i))));
+        ptrs.push_back(owned.back().get());
+      }
+      vector<Tick> ticks2(ptrs.size());
+      for(size_t i=0;i<ticks2.size();i++) ptrs2.push_back(&ticks2[i]);
+
+      vector<char> blob;
+      vector<uint64_t> offsets;
+      binSerializeBatch(ptrs.begin(), ptrs.end(), blob, offsets);
+      binDeserializeBatch(blob, offsets, ptrs2.begin());
+      bool same = true;
+      for(size_t i=0;i<ticks2.size();i++) same = same && sameTick(*owned[i], ticks2[i]);
+      if(!same) cerr << "batchPtr not equal\n";
+      else cout << "Test batchPtr passed\n";
+    }
+
+    // test parallel decompression of a compressed serialization
+    {
+      Tick big = makeTick(49);
+      big.prices.assign(200000, 1.25);
+      vector<char> packed, raw, plain;
+      big.binSerialize(packed, Compression(1, 4096));
+      decompressParallel(packed.data(), packed.size(), raw, 4);
+      big.binSerialize(plain);
+      Tick big2;
+      big2.binDeserialize(raw);
+      if(raw!=plain || !sameTick(big, big2)) cerr << "decompressParallel not equal\n";
+      else cout << "Test decompressParallel passed\n";
+    }
+
+    // test exceptions from workers reach the caller
+    {
+      vector<Thrower> throwers(100);
+      vector<char> blob;
+      vector<uint64_t> offsets;
+      bool caught = false;
+      try{ binSerializeBatch(throwers.begin(), throwers.end(), blob, offsets, 4); }
+      catch(runtime_error& e){ caught = string(e.what())=="Thrower"; }
+      if(!caught) cerr << "batchThrow not equal\n";
+      else cout << "Test batchThrow passed\n";
+    }
+
+    // test bad offset tables are rejected before any object is read
+    {
+      vector<Tick> ticks(3, makeTick(7)), ticks2(3);
+      vector<char> blob;
+      vector<uint64_t> offsets;
+      binSerializeBatch(ticks.begin(), ticks.end(), blob, offsets);
+      vector<uint64_t> unordered = offsets, beyond = offsets;
+      swap(unordered[1], unordered[2]);
+      beyond.back() += 1;
+      bool unorderedCaught = false, beyondCaught = false;
+      try{ binDeserializeBatch(blob.data(), unordered, ticks2.begin()); }
+      catch(runtime_error&){ unorderedCaught = true; }
+      try{ binDeserializeBatch(blob, beyond, ticks2.begin()); }
+      catch(runtime_error&){ beyondCaught = true; }
+      if(!unorderedCaught || !beyondCaught) cerr << "batchOffsets should throw\n";
+      else cout << "Test batchOffsets passed\n";
+    }
+
+  }catch(exception&e){
+    cerr << e.what() << endl;
+  }
+}
@@ -0,0 +1,121 @@
+// Built with SERIALATOR_PROFILE defined (for Serialator.cpp too)
+#include <sstream>
+#include <string>
+#include "../Serialator.h"
+
+using namespace std;
+using namespace codepi;
+
+class Leaf : public Serialator{
+public:
+  string name;
+  vector<double> values;
+protected:
+  void archive(Archive& ar, int version){
+    ar & name & values;
+  }
+};
+
+class Root : public Serialator{
+public:
+  map<string,Leaf> leaves;
+  vector<int> ids;
+  list<int> events;
+protected:
+  void archive(Archive& ar, int version){
+    ar & leaves & ids & events;
+  }
+};
+
+class FastRoot : public SerialatorT<FastRoot>{
+public:
+  vector<double> samples;
+  Leaf leaf;
+  template <typename Ar> void archive(Ar& ar, int version){
+    ar & samples & leaf;
+  }
+};
+
+// totals for the entry of direction named type (or, for templates, containing type)
+static ProfileEntry find(Archive::ArchiveType direction, const string& type){
+  vector<ProfileEntry> entries = Profiler::report();
+  bool partial = type.find('<')!=string::npos;
+  for(size_t i=0;i<entries.size();i++)
+    if(entries[i].direction==direction
+       && (partial ? entries[i].type.find(type)!=string::npos : entries[i].type==type)) return entries[i];
+  ProfileEntry none = { direction, string(), 0, 0, 0 };
+  return none;
+}
+
+struct CountEntries{
+  size_t* count;
+  void operator()(const ProfileEntry&) const { (*count)++; }
+};
+
+int main(){
+  try{
+
+    Root root;
+    for(int i=0;i<50;i++){
+      Leaf& leaf = root.leaves["leaf" + to_string(i)];
+      leaf.name = "name" + to_string(i);
+      leaf.values.assign(100, i*0.5);
+      root.ids.push_back(i);
+      root.events.push_back(i);
+    }
+
+    // test bytes and calls per type for writing, sizing and reading
+    {
+      Profiler::reset();
+      vector<char> blob;
+      root.binSerialize(blob);
+      size_t size = root.binSerializedSize();
+      Root back;
+      back.binDeserialize(blob);
+      ProfileEntry w = find(Archive::WRITE_BIN, "Root");
+      ProfileEntry s = find(Archive::SERIAL_SIZE_BIN, "Root");
+      ProfileEntry r = find(Archive::READ_BIN, "Root");
+      ProfileEntry leafW = find(Archive::WRITE_BIN, "Leaf");
+      ProfileEntry vecW = find(Archive::WRITE_BIN, "vector<double");
+      ProfileEntry mapW = find(Archive::WRITE_BIN, "map<");
+      bool ok = w.calls==1 && w.bytes==blob.size() && s.bytes==size && r.bytes==blob.size()
+        && leafW.calls==50 && leafW.bytes==50*(4 + 4+6 + 4+800) - 10  // ten names of 5 chars
+        && vecW.calls==50 && vecW.bytes==50*(4+800) && mapW.calls==1 && mapW.bytes < w.bytes
+        && w.nanos>0;
+      if(!ok) cerr << "profileBytes not equal\n";
+      else cout << "Test profileBytes passed\n";
+    }
+
+    // test compile-time archives and streaming writers (bytes across drained blocks)
+    {
+      Profiler::reset();
+      FastRoot fast;
+      fast.samples.assign(100000, 1.5);
+      fast.leaf.name = "x";
+      vector<char> packed;
+      fast.binSerialize(packed, Compression(1, 4096));
+      ProfileEntry f = find(Archive::WRITE_BIN, "FastRoot");
+      ProfileEntry leafW = find(Archive::WRITE_BIN, "Leaf");
+      bool ok = f.calls==1 && f.bytes==fast.binSerializedSize() && leafW.calls==1;
+      if(!ok) cerr << "profileStatic not equal\n";
+      else cout << "Test profileStatic passed\n";
+    }
+
+    // test report export as text and through a callback
+    {
+      ostringstream os;
+      Profiler::print(os);
+      size_t count = 0;
+      CountEntries counter = { &count };
+      Profiler::forEach(counter);
+      bool ok = os.str().find("FastRoot")!=string::npos && count==Profiler::report().size() && count>0;
+      Profiler::reset();
+      ok = ok && Profiler::report().empty();
+      if(!ok) cerr << "profileReport not equal\n";
+      else cout << "Test profileReport passed\n";
+    }
+
+  }catch(exception&e){
+    cerr << e.what() << endl;
+  }
+}
@@ -0,0 +1,112 @@
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <algorithm>
+#include "../RecordLog.h"
+
+using namespace std;
+using namespace codepi;
+
+class Tick : public Serialator{
+public:
+  int seq;
+  string symbol;
+  vector<double> prices;
+protected:
+  void archive(Archive& ar, int version){
+    ar & seq & symbol & prices;
+  }
+};
+
+static Tick makeTick(int i){
+  Tick t;
+  t.seq = i;
+  t.symbol = "SYM" + to_string(i % 7);
+  t.prices.assign(i % 5, i * 0.5);
+  return t;
+}
+
+// check records 0..count-1 of the log match makeTick
+static bool checkLog(const RecordLogReader& log, size_t count){
+  if(log.size()!=count) return false;
+  for(size_t i=0;i<count;i++){
+    Tick t, expect = makeTick(int(i));
+    log.read(i, t);
+    if(t.seq!=expect.seq || t.symbol!=expect.symbol || t.prices!=expect.prices) return false;
+  }
+  size_t n = 0;
+  for(RecordLogReader::const_iterator it=log.begin(); it!=log.end(); ++it) n++;
+  return n==count;
+}
+
+// copy the first size bytes of src to dst (simulates a crash mid-write)
+static void copyPrefix(const string& src, const string& dst, size_t size){
+  ifstream ifs(src.c_str(), ios::binary);
+  string bytes((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+  ofstream ofs(dst.c_str(), ios::binary);
+  ofs.write(bytes.data(), min(size, bytes.size()));
+}
+
+int main(){
+  try{
+
+    // test write, close and indexed read
+    {
+      RecordLogWriter writer("test.log");
+      for(int i=0;i<100;i++){ Tick t = makeTick(i); writer.append(t); }
+    }
+    RecordLogReader log("test.log");
+    if(!checkLog(log, 100) || log.recovered()) cerr << "log not equal\n";
+    else cout << "Test log passed\n";
+
+    // test reopen in append mode
+    {
+      RecordLogWriter writer("test.log", true);
+      for(int i=100;i<150;i++){ Tick t = makeTick(i); writer.append(t); }
+    }
+    RecordLogReader logAppend("test.log");
+    if(!checkLog(logAppend, 150) || logAppend.recovered()) cerr << "logAppend not equal\n";
+    else cout << "Test logAppend passed\n";
+
+    // test recovery of a truncated tail (no index, last record torn)
+    RecordLogReader::Record last = logAppend.record(149);
+    size_t tornSize = (last.data - logAppend.record(0).data) + 8 + last.size/2;
+    copyPrefix("test.log", "test_torn.log", tornSize);
+    RecordLogReader logTorn("test_torn.log");
+    if(!checkLog(logTorn, 149) || !logTorn.recovered()) cerr << "logTorn not equal\n";
+    else cout << "Test logTorn passed\n";
+
+    // test appending after a crash drops the torn record
+    {
+      RecordLogWriter writer("test_torn.log", true);
+      Tick t = makeTick(149);
+      writer.append(t);
+    }
+    RecordLogReader logRepaired("test_torn.log");
+    if(!checkLog(logRepaired, 150) || logRepaired.recovered()) cerr << "logRepaired not equal\n";
+    else cout << "Test logRepaired passed\n";
+
+    // test corrupt index offsets and payloads are caught, not read out of bounds
+    {
+      ifstream ifs("test.log", ios::binary);
+      string bytes((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+      string badOffset = bytes, badPayload = bytes;
+      uint64_t huge = uint64_t(1) << 40;
+      size_t lastEntry = bytes.size() - 12 - 8;           // before footer
+      badOffset.replace(lastEntry, 8, (const char*)&huge, 8);
+      badPayload[8 + 8] ^= 0x55;                          // first byte of record 0
+      ofstream("test_torn.log", ios::binary).write(badOffset.data(), badOffset.size());
+      bool offsetCaught = false, payloadCaught = false;
+      RecordLogReader logBad("test_torn.log");
+      try{ logBad.record(149); }catch(runtime_error&){ offsetCaught = true; }
+      ofstream("test_torn.log", ios::binary).write(badPayload.data(), badPayload.size());
+      RecordLogReader logBadPayload("test_torn.log");
+      try{ Tick t; logBadPayload.read(0, t); }catch(runtime_error&){ payloadCaught = true; }
+      if(!offsetCaught || !payloadCaught || logBad.recovered()) cerr << "logCorrupt should throw\n";
+      else cout << "Test logCorrupt passed\n";
+    }
+
+  }catch(exception&e){
+    cerr<<e.what()<<endl;
+  }
+}
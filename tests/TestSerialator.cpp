@@ -3,6 +3,12 @@
 #include <string>
 #include <assert.h>
 #include "../Serialator.h"
+#include <climits>
+#include <limits>
+#ifdef SERIALATOR_CXX17
+#include <memory_resource>
+#include <charconv>
+#endif
 
 using namespace std;
 using namespace codepi;
@@ -51,6 +57,378 @@ bool operator==(const MyClass&a, const MyClass& b){
     && a.e==a.e;
 }
 
+// Compile-time specialized equivalents of Nested and MyClass
+
+class FastNested : public SerialatorT<FastNested>{
+public:
+  int x,y,z;
+  template <typename Ar> void archive(Ar& ar, int version){
+    ar & x & y & z; 
+  }
+};
+
+class FastClass : public SerialatorT<FastClass>{
+public:
+  FastClass(){initAll();}
+  vector<int> v;
+  string str;
+  map<string,int> mp;
+  FastNested fn;     // typed nested in typed
+  Nested n;          // classic nested in typed
+  vector<FastNested> vfn;
+  template <typename Ar> void archive(Ar& ar, int version){
+    ar & v & str & mp & fn & n & vfn;
+  }
+};
+
+class SlowClass : public Serialator{
+public:
+  vector<int> v;
+  string str;
+  map<string,int> mp;
+  Nested fn, n;
+  vector<Nested> vfn;
+protected:
+  void archive(Archive& ar, int version){
+    ar & v & str & mp & fn & n & vfn;
+  }
+};
+
+// Bitwise serializable POD types
+
+struct Point3f{ float x,y,z; };
+struct Point3fV2{ float x,y,z; };
+SERIALATOR_BITWISE(Point3f, 1)
+SERIALATOR_BITWISE(Point3fV2, 2)
+
+Archive& operator& (Archive& ar, Point3f& p){
+  ar & p.x & p.y & p.z;
+  return ar;
+}
+
+Archive& operator& (Archive& ar, Point3fV2& p){
+  ar & p.x & p.y & p.z;
+  return ar;
+}
+
+bool operator==(const Point3f&a, const Point3f& b){
+  return a.x==b.x && a.y==b.y && a.z==b.z;
+}
+
+template <typename P>
+class PointCloud : public Serialator{
+public:
+  vector<P> pts;
+  array<P,2> pair;
+  deque<P> dq;
+  deque<int> di;
+  vector<array<P,2> > segs;
+protected:
+  void archive(Archive& ar, int version){
+    ar & pts & pair & dq & di & segs;
+  }
+};
+
+// Owning message and matching zero-copy view of it
+
+class Message : public Serialator{
+public:
+  int id;
+  string name;
+  vector<double> samples;
+protected:
+  void archive(Archive& ar, int version){
+    ar & id & name & samples;
+  }
+};
+
+class MessageView : public Serialator{
+public:
+  int id;
+  ArrayView<char> name;
+  ArrayView<double> samples;
+protected:
+  void archive(Archive& ar, int version){
+    ar & id & name & samples;
+  }
+};
+
+#ifdef SERIALATOR_CXX17
+class MessageStringView : public Serialator{
+public:
+  int id;
+  string_view name;
+  ArrayView<double> samples;
+protected:
+  void archive(Archive& ar, int version){
+    ar & id & name & samples;
+  }
+};
+#endif
+
+// Message of node containers and strings, with standard and pmr allocators
+
+class NodeMessage : public Serialator{
+public:
+  vector<string> tags;
+  map<string,int> counts;
+  list<string> history;
+  set<string> keys;
+protected:
+  void archive(Archive& ar, int version){
+    ar & tags & counts & history & keys;
+  }
+};
+
+#ifdef SERIALATOR_CXX17
+class ArenaMessage : public Serialator{
+public:
+  explicit ArenaMessage(pmr::memory_resource* mr) 
+    : tags(mr), counts(mr), history(mr), keys(mr) {}
+  pmr::vector<pmr::string> tags;
+  pmr::map<pmr::string,int> counts;
+  pmr::list<pmr::string> history;
+  pmr::set<pmr::string> keys;
+protected:
+  void archive(Archive& ar, int version){
+    ar & tags & counts & history & keys;
+  }
+};
+#endif
+
+// Edge values for the text formatting engine
+
+class TextValues : public Serialator{
+public:
+  int i; long long ll; unsigned long long ull; short sh;
+  char c; signed char sc; bool b;
+  float f; double d;
+  string s;
+protected:
+  void archive(Archive& ar, int version){
+    ar & i & ll & ull & sh & c & sc & b & f & d & s;
+  }
+};
+
+// Mixed widths for the fixed endian formats
+
+class EndianValues : public Serialator{
+public:
+  uint32_t tag; long l; unsigned long ul; short sh; double d;
+  vector<double> dv; vector<int16_t> sv; array<uint32_t,5> ua; deque<int64_t> dq;
+  vector<long> lv; vector<Point3f> pts; string s;
+  bool operator==(const EndianValues& o) const{
+    return tag==o.tag && l==o.l && ul==o.ul && sh==o.sh && d==o.d && dv==o.dv && sv==o.sv
+      && ua==o.ua && dq==o.dq && lv==o.lv && pts==o.pts && s==o.s;
+  }
+protected:
+  void archive(Archive& ar, int version){
+    ar & tag & l & ul & sh & d & dv & sv & ua & dq & lv & pts & s;
+  }
+};
+
+// Numbers of one type, for the types the fixed byte order formats reject
+template <typename T>
+class Values : public Serialator{
+public:
+  vector<T> values;
+  T last = T();
+protected:
+  void archive(Archive& ar, int version){
+    ar & values & last;
+  }
+};
+
+// Market state snapshot for delta serialization
+
+class Quote : public Serialator{
+public:
+  double bid, ask;
+  int32_t size;
+  string venue;
+protected:
+  void archive(Archive& ar, int version){
+    ar & bid & ask & size & venue;
+  }
+};
+
+class MarketState : public Serialator{
+public:
+  int64_t seq;
+  string name;
+  vector<double> prices;
+  vector<string> notes;
+  array<int,4> flags;
+  map<string,Quote> quotes;
+  set<int> halted;
+  list<int> events;
+  deque<int16_t> ticks;
+  Quote top;
+  vector<Quote> book;
+  pair<int,string> tagged;
+protected:
+  void archive(Archive& ar, int version){
+    ar & seq & name & prices & notes & flags & quotes & halted & events & ticks 
+       & top & book & tagged;
+  }
+};
+
+// Archives its enum through a local converted copy
+class Routed : public Serialator{
+public:
+  enum Side{ BUY, SELL };
+  Side side;
+  int qty;
+protected:
+  void archive(Archive& ar, int version){
+    int32_t s = side;
+    ar & s & qty;
+    side = Side(s);
+  }
+};
+
+// Two schema versions of an order for the framed format: V2 adds trailing fields
+
+class QuoteV2 : public Quote{
+public:
+  string exchange;
+  vector<int> lots;
+protected:
+  void archive(Archive& ar, int version){
+    Quote::archive(ar, version);
+    ar & exchange & lots;
+  }
+};
+
+class OrderV1 : public Serialator{
+public:
+  int32_t id;
+  Quote quote;
+  string owner;
+protected:
+  void archive(Archive& ar, int version){
+    ar & id & quote & owner;
+  }
+};
+
+class OrderV2 : public Serialator{
+public:
+  int32_t id;
+  QuoteV2 quote;
+  string owner;
+  vector<double> fills;
+protected:
+  void archive(Archive& ar, int version){
+    ar & id & quote & owner & fills;
+  }
+};
+
+class OrderLite : public Serialator{
+public:
+  int32_t id;
+  SkipNested quote;
+  string owner;
+protected:
+  void archive(Archive& ar, int version){
+    ar & id & quote & owner;
+  }
+};
+
+// Envelopes whose payloads are decoded on first access
+
+class Envelope : public Serialator{
+public:
+  int32_t seq;
+  Lazy<OrderV2> order;
+  Lazy<MyClass> detail;
+  string tag;
+protected:
+  void archive(Archive& ar, int version){
+    ar & seq & order & detail & tag;
+  }
+};
+
+class EnvelopePlain : public Serialator{
+public:
+  int32_t seq;
+  OrderV2 order;
+  MyClass detail;
+  string tag;
+protected:
+  void archive(Archive& ar, int version){
+    ar & seq & order & detail & tag;
+  }
+};
+
+class FastEnvelope : public SerialatorT<FastEnvelope>{
+public:
+  int32_t seq;
+  Lazy<FastNested> pos;
+  template <typename Ar> void archive(Ar& ar, int version){
+    ar & seq & pos;
+  }
+};
+
+// Hash containers, and their ordered counterparts sharing the wire format
+
+class HashedState : public Serialator{
+public:
+  unordered_map<string,Quote> quotes;
+  unordered_set<int64_t> ids;
+protected:
+  void archive(Archive& ar, int version){
+    ar & quotes & ids;
+  }
+};
+
+class OrderedState : public Serialator{
+public:
+  map<string,Quote> quotes;
+  set<int64_t> ids;
+protected:
+  void archive(Archive& ar, int version){
+    ar & quotes & ids;
+  }
+};
+
+class FastHashed : public SerialatorT<FastHashed>{
+public:
+  unordered_map<int32_t,string> names;
+  template <typename Ar> void archive(Ar& ar, int version){
+    ar & names;
+  }
+};
+
+static bool sameQuote(const Quote& a, const Quote& b){
+  return a.bid==b.bid && a.ask==b.ask && a.size==b.size && a.venue==b.venue;
+}
+
+static bool sameHashed(HashedState& a, HashedState& b){
+  if(a.ids!=b.ids || a.quotes.size()!=b.quotes.size()) return false;
+  for(auto& q : a.quotes){
+    auto found = b.quotes.find(q.first);
+    if(found==b.quotes.end() || !sameQuote(q.second, found->second)) return false;
+  }
+  return true;
+}
+
+// Copyable only through cloneFrom
+
+class Pinned : public Serialator{
+public:
+  Pinned() {}
+  vector<Quote> book;
+  map<int,vector<int16_t> > levels;
+  Lazy<Quote> last;
+protected:
+  void archive(Archive& ar, int version){
+    ar & book & levels & last;
+  }
+private:
+  Pinned(const Pinned&);
+  Pinned& operator=(const Pinned&);
+};
+
 // Method 1 for external struct
 
 struct ExternalStruct{
@@ -148,6 +526,22 @@ int main(){
     if(buffBin.size()!=serialBinSize) cerr << "buffBin.size() should match serialBinSize\n";
     else cout << "Test mc4b passed\n";
 
+    // test single pass append into a reused buffer
+    MyClass mc4c, mc4d;
+    vector<char> appendBuff;
+    size_t firstSize = mc.binSerializeAppend(appendBuff);
+    size_t secondSize = mc.binSerializeAppend(appendBuff, 4096);
+    mc4c.binDeserialize(appendBuff.data(), firstSize);
+    mc4d.binDeserialize(appendBuff.data()+firstSize, secondSize);
+    const char* appendData = appendBuff.data();
+    appendBuff.clear();
+    mc.binSerializeAppend(appendBuff);
+    if(!(mc==mc4c) || !(mc==mc4d)) cerr << "mc4c/mc4d not equal\n";
+    else if(firstSize!=buffBin.size() || secondSize!=buffBin.size() || appendBuff!=buffBin)
+      cerr << "appended size should match serialBinSize\n";
+    else if(appendBuff.data()!=appendData) cerr << "reused buffer should not reallocate\n";
+    else cout << "Test mc4c passed\n";
+
     // test binary char* serialization
     MyClass mc5;
     int maxSizeBin = 10000;
@@ -160,6 +554,681 @@ int main(){
     if(sizeBin!=serialBinSize) cerr << "sizeBin should match serialBinSize\n";
     else cout << "Test mc5b passed\n";
 
+    // test binary char* bounds checking
+    bool overflowCaught = false, truncCaught = false;
+    char smallBuff[16];
+    try{ mc.binSerialize(smallBuff, sizeof(smallBuff)); }
+    catch(runtime_error&){ overflowCaught = true; }
+    try{ MyClass mc5c; mc5c.binDeserialize(buffBin.data(), buffBin.size()-1); }
+    catch(runtime_error&){ truncCaught = true; }
+    if(!overflowCaught || !truncCaught) cerr << "buffer bounds not checked\n";
+    else cout << "Test mc5c passed\n";
+
+    // test compile-time specialized archives match the runtime Archive
+    FastClass fc, fc2;
+    SlowClass sc;
+    fc.v = sc.v = mc.v;
+    fc.str = sc.str = mc.str;
+    fc.mp = sc.mp = mc.mp;
+    fc.fn.x = sc.fn.x = 7; fc.fn.y = sc.fn.y = 8; fc.fn.z = sc.fn.z = 9;
+    fc.n = sc.n = mc.n;
+    fc.vfn.resize(2); sc.vfn.resize(2);
+    fc.vfn[1].y = sc.vfn[1].y = 42;
+    vector<char> fastBuff, slowBuff, fastBuff2;
+    fc.binSerialize(fastBuff);
+    sc.binSerialize(slowBuff);
+    fc2.binDeserialize(fastBuff);
+    fc2.binSerialize(fastBuff2);
+    stringstream fastStream;
+    fc.binSerialize(fastStream);
+    if(fastBuff!=slowBuff || fastBuff2!=slowBuff || fastStream.str()!=string(slowBuff.begin(),slowBuff.end()))
+      cerr << "StaticArchive output should match Archive output\n";
+    else cout << "Test fc passed\n";
+
+    // test bitwise serializable bulk transfer
+    PointCloud<Point3f> pc, pc2, pct;
+    for(int i=0;i<1000;i++){ 
+      Point3f p = { float(i), float(2*i), float(3*i) };
+      pc.pts.push_back(p);
+      pc.dq.push_back(p);
+      pc.di.push_back(i);
+      array<Point3f,2> seg = {{ p, p }};
+      pc.segs.push_back(seg);
+    }
+    pc.pair[0] = pc.pts[1]; pc.pair[1] = pc.pts[2];
+    vector<char> pcBuff;
+    pc.binSerialize(pcBuff);
+    pc2.binDeserialize(pcBuff);
+    stringstream pcText;
+    pc.textSerialize(pcText);
+    pct.textDeserialize(pcText);
+    bool pcEqual = pc.pts==pc2.pts && pc.pair==pc2.pair && pc.dq==pc2.dq && pc.di==pc2.di
+      && pc.segs==pc2.segs && pc.pts==pct.pts && pc.dq==pct.dq && pc.segs==pct.segs;
+    bool layoutCaught = false;
+    try{ PointCloud<Point3fV2> pcv2; pcv2.binDeserialize(pcBuff); }
+    catch(runtime_error&){ layoutCaught = true; }
+    if(!pcEqual) cerr << "pc not equal\n";
+    else if(!layoutCaught) cerr << "bitwise layout mismatch not detected\n";
+    else cout << "Test pc passed\n";
+
+    // test compact varint binary format
+    MyClass mcc1, mcc2, mcc3, mcc4;
+    mc.c = -5;
+    mc.v.push_back(-1000000);
+    vector<char> compactBuff;
+    mc.binSerialize(compactBuff, Archive::BIN_COMPACT);
+    mcc1.binDeserialize(compactBuff, Archive::BIN_COMPACT);
+    stringstream compactStream;
+    mc.binSerialize(compactStream, Archive::BIN_COMPACT);
+    mcc2.binDeserialize(compactStream, Archive::BIN_COMPACT);
+    vector<char> compactBlob(10000);
+    int compactSize = mc.binSerialize(compactBlob.data(), compactBlob.size(), Archive::BIN_COMPACT);
+    mcc3.binDeserialize(compactBlob.data(), compactSize, Archive::BIN_COMPACT);
+    mc.binSerializeFile("test.bin", Archive::BIN_COMPACT);
+    mcc4.binDeserializeFile("test.bin", Archive::BIN_COMPACT);
+    vector<char> fullBuff;
+    mc.binSerialize(fullBuff);
+    bool compactTruncCaught = false;
+    try{ mcc1.binDeserialize(compactBuff.data(), compactBuff.size()-1, Archive::BIN_COMPACT); }
+    catch(runtime_error&){ compactTruncCaught = true; }
+    mc.v.pop_back();
+    mc.c = 0;
+    if(!(mcc1==mcc2) || !(mcc1==mcc3) || !(mcc1==mcc4) || mcc1.c!=-5 || mcc1.v.back()!=-1000000)
+      cerr << "compact not equal\n";
+    else if(compactSize!=int(compactBuff.size()) || compactStream.str().size()!=compactBuff.size())
+      cerr << "compact sizes should match\n";
+    else if(compactBuff.size()*2 > fullBuff.size()) cerr << "compact should be smaller\n";
+    else if(!compactTruncCaught) cerr << "compact truncation not detected\n";
+    else cout << "Test mcc passed\n";
+
+    // test zero-copy views into the source buffer, aligned and unaligned
+    Message msg;
+    msg.id = 7;
+    msg.name = "sensor";
+    msg.samples.push_back(1.5);
+    msg.samples.push_back(-2.25);
+    vector<char> msgBuff(1);           // leading byte to misalign the payload
+    msg.binSerializeAppend(msgBuff);
+    MessageView mv;
+    mv.binDeserialize(msgBuff.data()+1, msgBuff.size()-1);
+    bool viewOk = mv.id==7 && string(mv.name.bytes(), mv.name.size())=="sensor"
+      && mv.samples.size()==2 && mv.samples[0]==1.5 && mv.samples[1]==-2.25
+      && mv.samples.toVector()==msg.samples
+      && mv.name.bytes() > msgBuff.data() && mv.name.bytes() < msgBuff.data()+msgBuff.size();
+    vector<char> viewBuff;
+    mv.binSerialize(viewBuff);
+    viewOk = viewOk && viewBuff==vector<char>(msgBuff.begin()+1, msgBuff.end());
+    bool viewStreamCaught = false;
+    try{ stringstream ssv(string(msgBuff.begin()+1, msgBuff.end())); mv.binDeserialize(ssv); }
+    catch(runtime_error&){ viewStreamCaught = true; }
+#ifdef SERIALATOR_CXX17
+    MessageStringView msv;
+    msv.binDeserialize(msgBuff.data()+1, msgBuff.size()-1);
+    viewOk = viewOk && msv.name=="sensor" && msv.samples[1]==-2.25;
+#endif
+    msg.binSerializeFile("test.bin");
+    MappedFile msgFile("test.bin");
+    MessageView mvf;
+    mvf.binDeserialize(msgFile);
+    viewOk = viewOk && msgFile.isMapped() && mvf.samples[1]==-2.25
+      && mvf.samples.bytes() >= msgFile.data() && mvf.samples.bytes() < msgFile.data()+msgFile.size();
+    if(!viewOk) cerr << "mv not equal\n";
+    else if(!viewStreamCaught) cerr << "view from stream should throw\n";
+    else cout << "Test mv passed\n";
+
+    // test node containers deserialized into a monotonic arena
+    NodeMessage nm;
+    for(int i=0;i<20;i++){
+      string longStr = "a string too long for the small string buffer " + to_string(i);
+      nm.tags.push_back(longStr);
+      nm.counts[longStr] = i;
+      nm.history.push_back(longStr);
+      nm.keys.insert(longStr);
+    }
+    vector<char> nmBuff;
+    nm.binSerialize(nmBuff);
+    bool arenaOk = true;
+#ifdef SERIALATOR_CXX17
+    {
+      vector<char> arenaBuff(1<<16);
+      pmr::monotonic_buffer_resource arena(arenaBuff.data(), arenaBuff.size(), pmr::null_memory_resource());
+      ArenaMessage am(&arena);
+      pmr::memory_resource* oldDefault = pmr::set_default_resource(pmr::null_memory_resource());
+      try{ am.binDeserialize(nmBuff); }      // any allocation outside the arena throws
+      catch(bad_alloc&){ arenaOk = false; }
+      pmr::set_default_resource(oldDefault);
+      vector<char> amBuff;
+      am.binSerialize(amBuff);
+      stringstream amText;
+      nm.textSerialize(amText);
+      ArenaMessage amt(pmr::get_default_resource());
+      amt.textDeserialize(amText);
+      arenaOk = arenaOk && amBuff==nmBuff && amt.counts==am.counts && amt.history==am.history;
+    }
+#endif
+    if(!arenaOk) cerr << "arena not equal\n";
+    else cout << "Test arena passed\n";
+
+    // test reuse mode deserialization keeps existing nodes and string capacity
+    NodeMessage nr;
+    nr.binDeserialize(nmBuff, Archive::BIN_REUSE);
+    const string* firstHistory = &nr.history.front();
+    const char* firstTag = nr.tags.front().data();
+    nr.binDeserialize(nmBuff, Archive::BIN_REUSE);
+    bool reuseOk = nr.tags==nm.tags && nr.counts==nm.counts && nr.history==nm.history 
+      && nr.keys==nm.keys && &nr.history.front()==firstHistory && nr.tags.front().data()==firstTag;
+#ifdef SERIALATOR_CXX17
+    const pair<const string,int>* firstCount = &*nr.counts.begin();
+    nr.binDeserialize(nmBuff, Archive::BIN_REUSE);
+    reuseOk = reuseOk && &*nr.counts.begin()==firstCount;
+#endif
+    NodeMessage shrunk;
+    shrunk.counts["x"] = 1;
+    shrunk.history.push_back("y");
+    vector<char> shrunkBuff;
+    shrunk.binSerialize(shrunkBuff);
+    nr.binDeserialize(shrunkBuff, Archive::BIN_REUSE | Archive::BIN_DEFAULT);
+    reuseOk = reuseOk && nr.tags.empty() && nr.counts==shrunk.counts && nr.history==shrunk.history
+      && nr.keys.empty();
+    if(!reuseOk) cerr << "reuse not equal\n";
+    else cout << "Test reuse passed\n";
+
+    // test block compressed serialization
+    NodeMessage snap;
+    for(int i=0;i<5000;i++){
+      string key = "instrument/equity/" + to_string(i % 50) + "/price_" + to_string(i);
+      snap.counts[key] = i;
+      snap.history.push_back("status=OK;venue=XNAS;session=regular");
+    }
+    vector<char> snapPlain, snapPacked, snapPacked9, snapStored;
+    snap.binSerialize(snapPlain);
+    snap.binSerialize(snapPacked, Compression(1, 4096));
+    snap.binSerialize(snapPacked9, Compression(9));
+    snap.binSerialize(snapStored, Compression(0));
+    NodeMessage snap1, snap9, snap0, snapF, snapS;
+    snap1.binDeserialize(snapPacked, Compression());
+    snap9.binDeserialize(snapPacked9, Compression());
+    snap0.binDeserialize(snapStored, Compression());
+    snap.binSerializeFile("test.bin", Compression(2));
+    snapF.binDeserializeFile("test.bin", Compression());
+    stringstream snapStream;
+    snap.binSerialize(snapStream, Compression(1, 4096));
+    snapS.binDeserialize(snapStream, Compression());
+    bool compOk = snapPacked.size()*3 < snapPlain.size() && snapPacked9.size() <= snapPacked.size()
+      && snapStored.size() > snapPlain.size();
+    for(NodeMessage* n : {&snap1, &snap9, &snap0, &snapF, &snapS})
+      compOk = compOk && n->counts==snap.counts && n->history==snap.history;
+    bool corruptCaught = false, shortCaught = false, compViewCaught = false;
+    vector<char> bad = snapPacked;
+    for(size_t i=20; i<bad.size(); i+=97) bad[i] ^= 0x5a;
+    try{ NodeMessage n; n.binDeserialize(bad, Compression()); }
+    catch(runtime_error&){ corruptCaught = true; }
+    bad.assign(snapPacked.begin(), snapPacked.end()-20);
+    try{ NodeMessage n; n.binDeserialize(bad, Compression()); }
+    catch(runtime_error&){ shortCaught = true; }
+    bool emptyBlockCaught = false;
+    bad = snapPacked;
+    memset(&bad[8], 0, 4);                              // compressed block with no bytes
+    stringstream emptyBlock(string(bad.begin(), bad.end()));
+    try{ NodeMessage n; n.binDeserialize(emptyBlock, Compression()); }
+    catch(runtime_error&){ emptyBlockCaught = true; }
+    vector<char> msgPacked;
+    msg.binSerialize(msgPacked, Compression());
+    try{ MessageView v; v.binDeserialize(msgPacked, Compression()); }
+    catch(runtime_error&){ compViewCaught = true; }
+    if(!compOk) cerr << "compressed not equal\n";
+    else if(!corruptCaught || !shortCaught || !emptyBlockCaught) 
+      cerr << "corrupt compressed data should throw\n";
+    else if(!compViewCaught) cerr << "view from compressed data should throw\n";
+    else cout << "Test compressed passed\n";
+
+    // test CRC32C checked frames: round trip, corruption and truncation detected
+    bool checkedOk = Crc32c::compute("123456789", 9)==0xE3069283 
+      && Crc32c::extend(Crc32c::compute("1234", 4), "56789", 5)==0xE3069283;
+    vector<char> chkBuff, chkCompact;
+    snap.binSerialize(chkBuff, Archive::BIN_CHECKED);
+    snap.binSerialize(chkCompact, Archive::BIN_CHECKED | Archive::BIN_COMPACT);
+    checkedOk = checkedOk && chkBuff.size()==snapPlain.size()+12 
+      && equal(snapPlain.begin(), snapPlain.end(), chkBuff.begin()+12)
+      && Crc32c::compute(snapPlain.data(), snapPlain.size())==*(const uint32_t*)(chkBuff.data()+8);
+    NodeMessage chk1, chk2, chk3, chk4, chk5;
+    chk1.binDeserialize(chkBuff, Archive::BIN_CHECKED);
+    chk2.binDeserialize(chkCompact, Archive::BIN_CHECKED | Archive::BIN_COMPACT);
+    vector<char> chkBlob(chkBuff.size()+100);
+    int chkSize = snap.binSerialize(chkBlob.data(), chkBlob.size(), Archive::BIN_CHECKED);
+    chk3.binDeserialize(chkBlob.data(), chkBlob.size(), Archive::BIN_CHECKED);
+    stringstream chkStream;
+    snap.binSerialize(chkStream, Archive::BIN_CHECKED);
+    chk4.binDeserialize(chkStream, Archive::BIN_CHECKED);
+    snap.binSerializeFile("test.bin", Archive::BIN_CHECKED);
+    chk5.binDeserializeFile("test.bin", Archive::BIN_CHECKED);
+    checkedOk = checkedOk && chkSize==int(chkBuff.size()) && chkStream.str().size()==chkBuff.size();
+    for(NodeMessage* n : {&chk1, &chk2, &chk3, &chk4, &chk5})
+      checkedOk = checkedOk && n->counts==snap.counts && n->history==snap.history;
+    int flips = 0, flipsCaught = 0;
+    for(size_t i=0; i<chkBuff.size(); i+=chkBuff.size()/7, flips++){
+      vector<char> bad = chkBuff;
+      bad[i] ^= 0x10;
+      try{ NodeMessage n; n.binDeserialize(bad, Archive::BIN_CHECKED); }
+      catch(runtime_error&){ flipsCaught++; }
+    }
+    bool chkShortCaught = false;
+    try{ NodeMessage n; n.binDeserialize(chkBuff.data(), chkBuff.size()-1, Archive::BIN_CHECKED); }
+    catch(runtime_error&){ chkShortCaught = true; }
+    if(!checkedOk) cerr << "checked not equal\n";
+    else if(flipsCaught!=flips || !chkShortCaught) cerr << "corrupt checked data should throw\n";
+    else cout << "Test checked passed\n";
+
+    // test fixed endian formats: exact wire bytes, round trips and SIMD swaps
+    EndianValues ev;
+    ev.tag = 0x01020304; ev.l = -2; ev.ul = 3; ev.sh = -300; ev.d = 0.1;
+    for(int i=0;i<1001;i++) ev.dv.push_back(i*0.5 - 100);
+    for(int i=0;i<37;i++) ev.sv.push_back(int16_t(i*1000 - 9000));
+    for(int i=0;i<5;i++) ev.ua[i] = 0x10203040u * i;
+    for(int i=0;i<3000;i++) ev.dq.push_back(int64_t(i) << 40 | i);
+    ev.lv.assign(5, -123456789L);
+    Point3f pt = {1.5f, -2.5f, 3.25f};
+    ev.pts.assign(3, pt);
+    ev.s = "portable";
+    vector<char> leBuff, beBuff;
+    ev.binSerialize(leBuff, Archive::BIN_LITTLE_ENDIAN);
+    ev.binSerialize(beBuff, Archive::BIN_BIG_ENDIAN);
+    const char leTag[] = {4,3,2,1}, beTag[] = {1,2,3,4};
+    const char beLong[] = {-1,-1,-1,-1,-1,-1,-1,-2};
+    bool endianOk = leBuff.size()==beBuff.size() && memcmp(&leBuff[4], leTag, 4)==0 
+      && memcmp(&beBuff[4], beTag, 4)==0 && memcmp(&beBuff[8], beLong, 8)==0;
+    EndianValues ev1, ev2, ev3, ev4;
+    ev1.binDeserialize(leBuff, Archive::BIN_LITTLE_ENDIAN);
+    ev2.binDeserialize(beBuff, Archive::BIN_BIG_ENDIAN);
+    stringstream beStream;
+    ev.binSerialize(beStream, Archive::BIN_BIG_ENDIAN);
+    ev3.binDeserialize(beStream, Archive::BIN_BIG_ENDIAN);
+    vector<char> beCompact;
+    ev.binSerialize(beCompact, Archive::BIN_BIG_ENDIAN | Archive::BIN_COMPACT | Archive::BIN_CHECKED);
+    ev4.binDeserialize(beCompact, Archive::BIN_BIG_ENDIAN | Archive::BIN_COMPACT | Archive::BIN_CHECKED);
+    endianOk = endianOk && ev1==ev && ev2==ev && ev3==ev && ev4==ev && beStream.str().size()==beBuff.size();
+    for(size_t size : {2, 4, 8, 16}){
+      vector<char> raw(8*size+9*size), simd(raw.size()), scalar(raw.size());
+      for(size_t i=0;i<raw.size();i++) raw[i] = char(i*7+1);
+      for(size_t n=0; n<raw.size()/size-1; n++){
+        ByteOrder::swapArray(&simd[1], &raw[1], n, size);
+        ByteOrder::swapElements(&scalar[1], &raw[1], n, size);
+        endianOk = endianOk && simd==scalar;
+      }
+    }
+    Archive::BinFormat foreign = ByteOrder::HOST_BIG ? Archive::BIN_LITTLE_ENDIAN : Archive::BIN_BIG_ENDIAN;
+    vector<char> foreignMsg;
+    msg.binSerialize(foreignMsg, foreign);
+    bool foreignViewCaught = false;
+    try{ MessageView v; v.binDeserialize(foreignMsg, foreign); }
+    catch(runtime_error&){ foreignViewCaught = true; }
+    Values<long double> ldv;
+    Values<wchar_t> wcv;
+    ldv.values.assign(3, 1.5L);
+    wcv.values.assign(3, L'x');
+    int nonPortableCaught = 0;
+    try{ ldv.binSerialize(foreignMsg, Archive::BIN_LITTLE_ENDIAN); }
+    catch(runtime_error&){ nonPortableCaught++; }
+    try{ wcv.binSerialize(foreignMsg, Archive::BIN_BIG_ENDIAN); }
+    catch(runtime_error&){ nonPortableCaught++; }
+    ldv.binSerialize(foreignMsg);                  // host order still allowed
+    try{ ldv.binDeserialize(foreignMsg, Archive::BIN_LITTLE_ENDIAN); }
+    catch(runtime_error&){ nonPortableCaught++; }
+    if(!endianOk) cerr << "endian not equal\n";
+    else if(!foreignViewCaught) cerr << "view of byte swapped data should throw\n";
+    else if(nonPortableCaught!=3) cerr << "non-portable types in fixed byte order should throw\n";
+    else cout << "Test endian passed\n";
+
+    // test delta serialization against a baseline
+    MarketState base;
+    base.initAll();
+    base.seq = 1;
+    base.name = "XNAS";
+    for(int i=0;i<2000;i++) base.prices.push_back(100 + i*0.01);
+    for(int i=0;i<10;i++) base.notes.push_back("note " + to_string(i));
+    for(int i=0;i<300;i++){
+      Quote q;
+      q.bid = i; q.ask = i+0.5; q.size = 100; q.venue = "V" + to_string(i%3);
+      base.quotes["SYM" + to_string(i)] = q;
+      base.book.push_back(q);
+    }
+    for(int i=0;i<20;i++){ base.halted.insert(i*3); base.events.push_back(i); base.ticks.push_back(int16_t(i)); }
+    base.top = base.book[0];
+    base.tagged = make_pair(1, string("one"));
+    MarketState cur = base;
+    cur.seq = 2;
+    cur.prices[500] = -1;
+    cur.prices[501] = -2;
+    cur.prices[1999] = -3;
+    cur.prices.push_back(7);
+    cur.notes[3] = "changed";
+    cur.notes.pop_back();
+    cur.flags[2] = 9;
+    cur.quotes["SYM17"].bid = 17.25;
+    cur.quotes.erase("SYM42");
+    cur.quotes["NEW"] = base.top;
+    cur.halted.erase(9);
+    cur.halted.insert(1000);
+    cur.events.push_back(99);
+    cur.ticks[5] = -5;
+    cur.top.venue = "ARCA";
+    cur.book[150].size = 7;
+    cur.tagged.second = "two";
+    vector<char> delta, curBuff, appliedBuff, sameDelta;
+    size_t deltaSize = cur.binSerializeDelta(base, delta);
+    cur.binSerialize(curBuff);
+    MarketState applied = base;
+    applied.binApplyDelta(delta);
+    applied.binSerialize(appliedBuff);
+    bool deltaOk = appliedBuff==curBuff && deltaSize==delta.size() && delta.size()*10 < curBuff.size();
+    deltaOk = deltaOk && cur.binSerializeDelta(cur, sameDelta)==5;
+    applied.binApplyDelta(sameDelta);
+    applied.binSerialize(appliedBuff);
+    deltaOk = deltaOk && appliedBuff==curBuff;
+    base.binSerializeDelta(cur, delta);           // reverse direction shrinks
+    MarketState reverted = cur;
+    reverted.binApplyDelta(delta);
+    vector<char> baseBuff, revertedBuff;
+    base.binSerialize(baseBuff);
+    reverted.binSerialize(revertedBuff);
+    deltaOk = deltaOk && baseBuff==revertedBuff;
+    bool deltaTruncCaught = false, deltaTypeCaught = false, deltaBaseCaught = false;
+    try{ MarketState t = cur; t.binApplyDelta(delta.data(), int(delta.size())-1); }
+    catch(runtime_error&){ deltaTruncCaught = true; }
+    try{ MarketState t = base; t.binApplyDelta(delta); }  // delta is against cur
+    catch(runtime_error&){ deltaBaseCaught = true; }
+    try{ base.top.binSerializeDelta(base, delta); }
+    catch(runtime_error&){ deltaTypeCaught = true; }
+    Routed buy, sell, routed;                     // local in archive() is recorded by value
+    buy.side = Routed::BUY; buy.qty = 5;
+    sell.side = Routed::SELL; sell.qty = 5;
+    sell.binSerializeDelta(buy, delta);
+    routed = buy;
+    routed.binApplyDelta(delta);
+    deltaOk = deltaOk && routed.side==Routed::SELL && routed.qty==5;
+    if(!deltaOk) cerr << "delta not equal\n";
+    else if(!deltaTruncCaught || !deltaTypeCaught || !deltaBaseCaught) cerr << "bad delta should throw\n";
+    else cout << "Test delta passed\n";
+
+    // test framed nested objects: old readers skip new fields and whole sub-objects
+    OrderV2 o2;
+    o2.id = 42; o2.owner = "desk7";
+    o2.quote.bid = 1.5; o2.quote.ask = 1.75; o2.quote.size = 300; o2.quote.venue = "XNYS";
+    o2.quote.exchange = "NYSE";
+    for(int i=0;i<50000;i++){ o2.quote.lots.push_back(i); o2.fills.push_back(i*0.5); }
+    Archive::BinFormat framedFormats[] = { Archive::BIN_FRAMED,
+      Archive::BIN_FRAMED | Archive::BIN_COMPACT,
+      Archive::BIN_FRAMED | Archive::BIN_BIG_ENDIAN | Archive::BIN_CHECKED };
+    bool framedOk = true;
+    for(size_t f=0; f<sizeof(framedFormats)/sizeof(framedFormats[0]); f++){
+      Archive::BinFormat format = framedFormats[f];
+      vector<char> framedBuff;
+      o2.binSerialize(framedBuff, format);
+      stringstream framedStream;
+      o2.binSerialize(framedStream, format);
+      framedOk = framedOk && framedStream.str()==string(framedBuff.begin(), framedBuff.end());
+      OrderV1 o1, o1s;
+      o1.binDeserialize(framedBuff, format);
+      o1s.binDeserialize(framedStream, format);
+      OrderLite lite;
+      lite.binDeserialize(framedBuff, format);
+      OrderV2 back;
+      back.binDeserialize(framedBuff, format);
+      framedOk = framedOk && o1.id==42 && o1.owner=="desk7" && o1.quote.size==300 
+        && o1.quote.venue=="XNYS" && o1s.owner=="desk7" && o1s.quote.ask==1.75
+        && lite.id==42 && lite.owner=="desk7" 
+        && back.fills==o2.fills && back.quote.lots==o2.quote.lots && back.quote.exchange=="NYSE";
+    }
+    vector<char> plainBuff, framedBuff, v1Buff;
+    o2.binSerialize(plainBuff);
+    o2.binSerialize(framedBuff, Archive::BIN_FRAMED);
+    framedOk = framedOk && framedBuff.size()==plainBuff.size()+8;  // top level and quote
+    OrderV1 o1;
+    o1.binDeserialize(framedBuff, Archive::BIN_FRAMED);
+    o1.binSerialize(v1Buff, Archive::BIN_FRAMED);
+    bool framedShortCaught = false;
+    try{ OrderV2 t; t.binDeserialize(v1Buff, Archive::BIN_FRAMED); }  // fields not in frame
+    catch(runtime_error&){ framedShortCaught = true; }
+    if(!framedOk) cerr << "framed not equal\n";
+    else if(!framedShortCaught) cerr << "reading past a frame should throw\n";
+    else cout << "Test framed passed\n";
+
+    // test lazy nested objects: decoded on first access, copied verbatim if untouched
+    Envelope env;
+    env.seq = 7; env.tag = "t";
+    env.order = o2;
+    env.detail->a = 5;
+    vector<char> envBuff, envBuff2;
+    env.binSerialize(envBuff);
+    Envelope lazyEnv;
+    lazyEnv.binDeserialize(envBuff);
+    bool lazyOk = lazyEnv.order.pending() && lazyEnv.detail.pending() 
+      && lazyEnv.seq==7 && lazyEnv.tag=="t";
+    lazyEnv.binSerialize(envBuff2);
+    lazyOk = lazyOk && envBuff2==envBuff && lazyEnv.binSerializedSize()==envBuff.size();
+    lazyOk = lazyOk && lazyEnv.order->owner=="desk7" && lazyEnv.order->fills==o2.fills 
+      && !lazyEnv.order.pending() && lazyEnv.detail.pending();
+    lazyEnv.detail->a = 6;
+    lazyEnv.binSerialize(envBuff2);
+    stringstream envStream;
+    lazyEnv.binSerialize(envStream);
+    Envelope streamEnv;
+    streamEnv.binDeserialize(envStream);
+    lazyOk = lazyOk && envStream.str()==string(envBuff2.begin(), envBuff2.end()) 
+      && !streamEnv.detail.pending() && streamEnv.detail->a==6 && *streamEnv.detail==*lazyEnv.detail;
+    EnvelopePlain plainEnv;                       // with BIN_FRAMED, Lazy<T> reads a T
+    plainEnv.seq = 3; plainEnv.order = o2; plainEnv.tag = "p";
+    vector<char> plainEnvBuff;
+    plainEnv.binSerialize(plainEnvBuff, Archive::BIN_FRAMED);
+    Envelope framedEnv;
+    framedEnv.binDeserialize(plainEnvBuff, Archive::BIN_FRAMED);
+    lazyOk = lazyOk && framedEnv.order.pending() && framedEnv.tag=="p" 
+      && framedEnv.order->quote.lots==o2.quote.lots;
+    env.binSerializeFile("test.bin");             // file mapping is gone on return
+    Envelope fileEnv;
+    fileEnv.binDeserializeFile("test.bin");
+    lazyOk = lazyOk && !fileEnv.order.pending() && fileEnv.order->owner=="desk7";
+    FastEnvelope fastEnv, fastEnv2;
+    fastEnv.seq = 1; fastEnv.pos->x = 1; fastEnv.pos->y = 2; fastEnv.pos->z = 3;
+    vector<char> fastEnvBuff;
+    fastEnv.binSerialize(fastEnvBuff);
+    fastEnv2.binDeserialize(fastEnvBuff);
+    lazyOk = lazyOk && fastEnv2.pos.pending() && fastEnv2.pos->z==3 
+      && fastEnv.binSerializedSize()==fastEnvBuff.size();
+    vector<char> envPacked;                       // frames spanning drained blocks
+    env.binSerialize(envPacked, Compression(1, 4096));
+    Envelope envUnpacked;
+    envUnpacked.binDeserialize(envPacked, Compression());
+    lazyOk = lazyOk && envUnpacked.order->fills==o2.fills 
+      && envUnpacked.order->quote.lots==o2.quote.lots && envUnpacked.detail->a==5;
+    if(!lazyOk) cerr << "lazy not equal\n";
+    else cout << "Test lazy passed\n";
+
+    // test hash containers: reserved reads, ordered wire compatibility, sorted output
+    HashedState hs, hs2, hs3;
+    for(int i=0;i<200;i++){
+      Quote& q = hs.quotes["sym" + to_string(i)];
+      q.bid = i; q.ask = i+0.5; q.size = i*10; q.venue = "v" + to_string(i%3);
+      hs.ids.insert(int64_t(i)*1000003);
+    }
+    vector<char> hsBuff, hsBuff2;
+    hs.binSerialize(hsBuff);
+    hs2.binDeserialize(hsBuff);
+    unordered_map<string,Quote> reserved;
+    reserved.reserve(hs.quotes.size());
+    bool hashOk = sameHashed(hs, hs2) && hs.binSerializedSize()==hsBuff.size()
+      && hs2.quotes.bucket_count()==reserved.bucket_count();      // no rehash while reading
+    hs.binSerialize(hsBuff2, Archive::BIN_COMPACT);
+    hs2.binDeserialize(hsBuff2, Archive::BIN_COMPACT | Archive::BIN_REUSE);
+    hashOk = hashOk && sameHashed(hs, hs2);
+    stringstream hsText;
+    hs.textSerialize(hsText);
+    hs3.textDeserialize(hsText);
+    hashOk = hashOk && sameHashed(hs, hs3);
+    OrderedState os;                                // same wire format as map and set
+    os.binDeserialize(hsBuff);
+    hashOk = hashOk && os.quotes.size()==200 && sameQuote(os.quotes["sym7"], hs.quotes["sym7"])
+      && os.ids.size()==200 && *os.ids.rbegin()==int64_t(199)*1000003;
+    HashedState shuffled;                           // same contents, other insertion order
+    shuffled.quotes.rehash(1000);
+    for(int i=199;i>=0;i--){
+      shuffled.quotes["sym" + to_string(i)] = hs.quotes["sym" + to_string(i)];
+      shuffled.ids.insert(int64_t(i)*1000003);
+    }
+    vector<char> sortedBuff, sortedBuff2;
+    hs.binSerialize(sortedBuff, Archive::BIN_SORTED);
+    shuffled.binSerialize(sortedBuff2, Archive::BIN_SORTED);
+    hs3.binDeserialize(sortedBuff);
+    hashOk = hashOk && sortedBuff==sortedBuff2 && sortedBuff.size()==hsBuff.size() 
+      && sameHashed(hs, hs3);
+    HashedState hsBase = hs;                        // delta of edits in place
+    hs3.quotes.erase("sym5");
+    hs3.quotes["sym9"].bid = -1;
+    hs3.quotes["new"].venue = "n";
+    hs3.ids.insert(7);
+    vector<char> hsDelta;
+    hs3.binSerializeDelta(hsBase, hsDelta);
+    hsBase.binApplyDelta(hsDelta);
+    hashOk = hashOk && sameHashed(hsBase, hs3) && hsDelta.size() < 200;
+    FastHashed fh, fh2;
+    for(int i=0;i<50;i++) fh.names[i] = to_string(i);
+    vector<char> fhBuff;
+    fh.binSerialize(fhBuff);
+    fh2.binDeserialize(fhBuff);
+    hashOk = hashOk && fh2.names==fh.names && fh.binSerializedSize()==fhBuff.size();
+    if(!hashOk) cerr << "hashed not equal\n";
+    else cout << "Test hashed passed\n";
+
+    // test deep copies through archive(): any class, behind Serialator&, no buffer
+    MarketState cloned;
+    cloned.name = "stale";
+    cloned.prices.assign(5, 1.0);
+    cloned.quotes["OLD"] = base.top;
+    Serialator& clonedRef = cloned;
+    clonedRef.cloneFrom(cur);
+    vector<char> clonedBuff;
+    cloned.binSerialize(clonedBuff);
+    bool cloneOk = clonedBuff==curBuff && cloned.prices.data()!=cur.prices.data();
+    HashedState hsClone;
+    hsClone.cloneFrom(hs3);
+    cloneOk = cloneOk && sameHashed(hsClone, hs3);
+    Pinned pinned, pinnedClone;
+    pinned.book = cur.book;
+    pinned.levels[3].assign(10, int16_t(3));
+    pinned.last->venue = "L";
+    vector<char> pinnedBuff, pinnedBuff2;
+    pinned.binSerialize(pinnedBuff);
+    Pinned pinnedLazy;
+    pinnedLazy.binDeserialize(pinnedBuff);            // clone from a pending Lazy member
+    pinnedClone.cloneFrom(pinnedLazy);
+    pinnedClone.binSerialize(pinnedBuff2);
+    cloneOk = cloneOk && pinnedBuff2==pinnedBuff && pinnedClone.last->venue=="L";
+    Envelope envClone;
+    envClone.cloneFrom(lazyEnv);
+    cloneOk = cloneOk && envClone.order->owner=="desk7" && envClone.detail->a==6;
+    routed = buy;                                     // local in archive() copied by value
+    routed.cloneFrom(sell);
+    cloneOk = cloneOk && routed.side==Routed::SELL && routed.qty==5;
+    bool cloneTypeCaught = false;
+    try{ cloned.top.cloneFrom(cloned); }
+    catch(runtime_error&){ cloneTypeCaught = true; }
+    if(!cloneOk) cerr << "clone not equal\n";
+    else if(!cloneTypeCaught) cerr << "clone of another type should throw\n";
+    else cout << "Test clone passed\n";
+
+    // test hashing while encoding: equal to XXH64 of the serialized bytes in every format
+    string hashInput;
+    for(int i=0;i<1280;i++) hashInput += char(i);
+    Xxh64 pieces;
+    for(size_t at=0; at<hashInput.size(); at+=37) 
+      pieces.update(&hashInput[at], min(size_t(37), hashInput.size()-at));
+    bool hashValueOk = Xxh64::compute("", 0)==0xEF46DB3751D8E999ULL 
+      && Xxh64::compute("a", 1)==0xD24EC4F1A98C6E5BULL && Xxh64::compute("abc", 3)==0x44BC2CF5AD770999ULL
+      && Xxh64::compute(hashInput.data(), hashInput.size())==0xAFC184AD7938A354ULL
+      && pieces.digest()==0xAFC184AD7938A354ULL;
+    bool digestOk = cur.binHash()==Xxh64::compute(curBuff.data(), curBuff.size())
+      && cur.binHash()!=base.binHash();
+    Archive::BinFormat hashFormats[] = { Archive::BIN_COMPACT, Archive::BIN_BIG_ENDIAN, 
+      Archive::BIN_CHECKED | Archive::BIN_COMPACT, Archive::BIN_FRAMED, Archive::BIN_SORTED };
+    for(Archive::BinFormat f : hashFormats){
+      vector<char> formatBuff;
+      cur.binSerialize(formatBuff, f);
+      digestOk = digestOk && cur.binHash(f)==Xxh64::compute(formatBuff.data(), formatBuff.size());
+      hs.binSerialize(formatBuff, f);
+      digestOk = digestOk && hs.binHash(f)==Xxh64::compute(formatBuff.data(), formatBuff.size());
+    }
+    env.binSerialize(envBuff);                      // lazy frames spanning many hash blocks
+    digestOk = digestOk && env.binHash()==Xxh64::compute(envBuff.data(), envBuff.size())
+      && fastEnv.binHash()==Xxh64::compute(fastEnvBuff.data(), fastEnvBuff.size());
+    vector<char> hashPacked;
+    env.binSerialize(hashPacked, Compression());
+    Envelope hashUnpacked;
+    hashUnpacked.binDeserialize(hashPacked, Compression());
+    digestOk = digestOk && hashUnpacked.order->fills==o2.fills && hashUnpacked.binHash()==env.binHash();
+    if(!hashValueOk) cerr << "hash values not equal\n";
+    else if(!digestOk) cerr << "hash digests not equal\n";
+    else cout << "Test hash passed\n";
+
+    // test field by field comparison and the path to the first difference
+    string diffPath;
+    MarketState same;
+    same.cloneFrom(cur);
+    bool compareOk = cur.equals(same, &diffPath) && diffPath.empty() && cur.equals(cur)
+      && !cur.equals(base, &diffPath) && diffPath=="0";
+    same.book[150].size = 8;
+    compareOk = compareOk && !cur.equals(same, &diffPath) && diffPath=="10[150].2";
+    same.book[150].size = 7;
+    same.prices[1234] = 0;
+    compareOk = compareOk && !same.equals(cur, &diffPath) && diffPath=="2[1234]";
+    same.prices = cur.prices;
+    same.quotes["SYM17"].venue = "X";
+    size_t sym17 = distance(same.quotes.begin(), same.quotes.find("SYM17"));
+    compareOk = compareOk && !same.equals(cur, &diffPath) && diffPath=="5[" + to_string(sym17) + "].3";
+    same.quotes["SYM17"] = cur.quotes["SYM17"];
+    same.tagged.second = "three";
+    compareOk = compareOk && !same.equals(cur, &diffPath) && diffPath=="12" && !same.equals(cur);
+    same.tagged = cur.tagged;
+    same.prices[0] = numeric_limits<double>::quiet_NaN();
+    MarketState sameNan;
+    sameNan.cloneFrom(same);
+    compareOk = compareOk && same.equals(sameNan) && same.equals(cur)==false;  // bitwise, like bytes
+    compareOk = compareOk && hs.equals(shuffled) && !hs.equals(hs3, &diffPath) && diffPath.find("0[")==0;
+    compareOk = compareOk && pinnedClone.equals(pinned) && envClone.equals(lazyEnv) 
+      && !cur.top.equals(cur, &diffPath) && diffPath.empty();
+    routed = buy;                                     // differ only in a local of archive()
+    compareOk = compareOk && routed.equals(buy) && !sell.equals(buy, &diffPath) && diffPath=="0";
+    if(!compareOk) cerr << "compare not equal\n";
+    else cout << "Test compare passed\n";
+
+    // test text formatting engine: integers as operator<<, floats round trip
+    TextValues tv;
+    tv.i = INT_MIN; tv.ll = LLONG_MAX; tv.ull = ULLONG_MAX; tv.sh = -7;
+    tv.c = 'x'; tv.sc = 'y'; tv.b = true;
+    tv.f = 1.0f/3; tv.d = 0.1+0.2; tv.s = "two words";
+    vector<char> tvBuff;
+    tv.textSerialize(tvBuff);
+    ostringstream tvExpect;
+    tvExpect << tv.getStructVersion() << " " << tv.i << " " << tv.ll << " " << tv.ull << " " 
+             << tv.sh << " x y 1 ";
+    TextValues tv2, tv3;
+    tv2.textDeserialize(tvBuff);
+    stringstream tvStream(string(tvBuff.begin(), tvBuff.end()));
+    tv3.textDeserialize(tvStream);
+    bool textOk = string(tvBuff.begin(), tvBuff.end()).find(tvExpect.str())==0;
+    for(TextValues* t : {&tv2, &tv3}){
+      textOk = textOk && t->i==tv.i && t->ll==tv.ll && t->ull==tv.ull && t->sh==tv.sh 
+        && t->c==tv.c && t->sc==tv.sc && t->b==tv.b && t->s==tv.s;
+#ifdef __cpp_lib_to_chars
+      textOk = textOk && t->f==tv.f && t->d==tv.d;   // shortest round trip
+#endif
+    }
+    bool rangeCaught = false;
+    try{ const char bad[] = "0 1 2 3 99999 "; TextValues t; t.textDeserialize(bad, sizeof(bad)-1); }
+    catch(runtime_error&){ rangeCaught = true; }
+    if(!textOk) cerr << "text not equal\n";
+    else if(!rangeCaught) cerr << "text out of range value should throw\n";
+    else cout << "Test text passed\n";
+
     // test text stream serialization
     stringstream sst;
     MyClass mct2;
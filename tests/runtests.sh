@@ -8,3 +8,15 @@ echo TestSerialator
 echo --------------------------
 echo TestSerialator2
 ./TestSerialator2
+echo --------------------------
+echo TestRecordLog
+./TestRecordLog
+echo --------------------------
+echo TestParallelBatch
+./TestParallelBatch
+echo --------------------------
+echo TestAsyncFileWriter
+./TestAsyncFileWriter
+echo --------------------------
+echo TestProfile
+./TestProfile